@@ -1,52 +1,110 @@
 #include "Debugger.h"
 #include "lexer.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <sstream>
-static bool debugEnabled = true;
-void Debugger::enable(bool flag) {
-    debugEnabled = flag;
-}
-void Debugger::log(const std::string& message, int lineNumber) {
-    if (!debugEnabled) return;
-    std::ostringstream oss;
-    if (lineNumber >= 0) {
-        oss << "Debug (line " << lineNumber << "): ";
-    } else {
-        oss << "Debug: ";
+TraceLevel Debugger::currentLevel = TraceLevel::OFF;
+uint8_t Debugger::currentCategories = 0;
+struct TraceRecord {
+    TraceLevel level;
+    TraceCategory category;
+    int lineNumber;
+    std::string message;
+};
+static constexpr size_t traceCapacity = 256;
+// Each thread keeps the records of the script it is building, so scripts
+// run side by side never dump each other's trace.
+static thread_local std::array<TraceRecord, traceCapacity> traceRing;
+static thread_local size_t traceCount = 0;
+static bool traceEcho = false;
+static const char* categoryName(TraceCategory category) {
+    switch (category) {
+        case TRACE_LEXER: return "lexer";
+        case TRACE_PARSER: return "parser";
+        case TRACE_SCOPES: return "scopes";
+        case TRACE_CALLS: return "calls";
+        case TRACE_LOOPS: return "loops";
+        default: return "trace";
     }
-    oss << message;
-    std::cout << oss.str() << std::endl;
-}
-void Debugger::printContextTokens(Lexer& lexer, int contextSize) {
-    int lexerPos = lexer.getPosition();
-    lexer.setPosition(0);
-
-    std::vector<std::pair<Token, int>> tokensWithPos;
-    while (true) {
-        int pos = lexer.getPosition();
-        Token tok = lexer.nextToken();
-        tokensWithPos.emplace_back(tok, pos);
-        if (tok.type == Token::END) break;
+}
+static void writeRecord(std::ostream& out, const TraceRecord& record) {
+    out << "Trace [" << categoryName(record.category) << "]";
+    if (record.lineNumber >= 0)
+        out << " (line " << record.lineNumber << ")";
+    out << ": " << record.message << '\n';
+}
+void Debugger::configure(TraceLevel level, uint8_t categories) {
+    currentLevel = level;
+    currentCategories = categories;
+}
+void Debugger::setEcho(bool echo) {
+    traceEcho = echo;
+}
+void Debugger::log(TraceLevel level, TraceCategory category, const std::string& message, int lineNumber) {
+    TraceRecord& record = traceRing[traceCount++ % traceCapacity];
+    record.level = level;
+    record.category = category;
+    record.lineNumber = lineNumber;
+    record.message = message;
+    if (traceEcho) {
+        std::ostringstream line;
+        writeRecord(line, record);
+        std::cerr << line.str();
     }
-
-    int tokenIndex = 0;
-    for (; tokenIndex < (int)tokensWithPos.size(); tokenIndex++) {
-        if (tokensWithPos[tokenIndex].second >= lexerPos) break;
+}
+void Debugger::dump(std::ostream& out) {
+    if (traceCount == 0)
+        return;
+    size_t first = traceCount > traceCapacity ? traceCount - traceCapacity : 0;
+    out << "---- Last " << traceCount - first << " trace records ----\n";
+    for (size_t i = first; i < traceCount; ++i)
+        writeRecord(out, traceRing[i % traceCapacity]);
+    traceCount = 0;
+}
+void Debugger::clear() {
+    traceCount = 0;
+}
+bool Debugger::parseLevel(const std::string& name, TraceLevel& level) {
+    if (name == "off") level = TraceLevel::OFF;
+    else if (name == "info") level = TraceLevel::INFO;
+    else if (name == "debug") level = TraceLevel::DEBUG;
+    else if (name == "verbose") level = TraceLevel::VERBOSE;
+    else return false;
+    return true;
+}
+bool Debugger::parseCategories(const std::string& names, uint8_t& categories) {
+    categories = 0;
+    std::istringstream list(names);
+    std::string name;
+    while (std::getline(list, name, ',')) {
+        if (name == "all") categories |= TRACE_ALL;
+        else if (name == "lexer") categories |= TRACE_LEXER;
+        else if (name == "parser") categories |= TRACE_PARSER;
+        else if (name == "scopes") categories |= TRACE_SCOPES;
+        else if (name == "calls") categories |= TRACE_CALLS;
+        else if (name == "loops") categories |= TRACE_LOOPS;
+        else return false;
     }
-    if (tokenIndex >= (int)tokensWithPos.size()) tokenIndex = (int)tokensWithPos.size() - 1;
-
+    return categories != 0;
+}
+void Debugger::printContextTokens(const Lexer& lexer, int contextSize) {
+    if (!enabled(TraceLevel::VERBOSE, TRACE_LEXER))
+        return;
+    const std::vector<Token>& tokens = lexer.getTokens();
+    int tokenIndex = static_cast<int>(lexer.getPosition());
     int start = std::max(0, tokenIndex - contextSize);
-    int end = std::min((int)tokensWithPos.size() - 1, tokenIndex + contextSize);
-
-    Debugger::log("---- Token Context ----");
+    int end = std::min(static_cast<int>(tokens.size()) - 1, tokenIndex + contextSize);
+    log(TraceLevel::VERBOSE, TRACE_LEXER, "---- Token Context ----");
     for (int i = start; i <= end; ++i) {
-        const auto& [tok, pos] = tokensWithPos[i];
+        const Token& tok = tokens[i];
+        SourceLocation location = lexer.getLocation(tok.position);
         std::string prefix = (i == tokenIndex - 1) ? ">> " : "   ";
-        Debugger::log(prefix + "Token[" + std::to_string(i) + "] at pos " +
-                      std::to_string(pos) + ": \"" + tok.text +
-                      "\" (type=" + std::to_string(tok.type) + ")");
+        std::string text = tok.type == Token::VAR || tok.type == Token::STRING
+            ? SymbolTable::name(tok.symbol) + "\" (type=" + std::to_string(tok.type) + ", symbol=" + std::to_string(tok.symbol) + ")"
+            : std::string(lexer.text(tok)) + "\" (type=" + std::to_string(tok.type) + ")";
+        log(TraceLevel::VERBOSE, TRACE_LEXER, prefix + "Token[" + std::to_string(i) + "] at column " +
+            std::to_string(location.column) + ": \"" + text, location.line);
     }
-    Debugger::log("------------------------");
-
-    lexer.setPosition(lexerPos);
-}
+    log(TraceLevel::VERBOSE, TRACE_LEXER, "------------------------");
+}
\ No newline at end of file
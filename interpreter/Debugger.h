@@ -1,9 +1,55 @@
 #pragma once
+#include <cstdint>
+#include <ostream>
 #include <string>
 #include "lexer.h"
+// Tracing is compiled out of release (NDEBUG) builds unless PDEV_TRACE_ENABLED
+// is set explicitly. When compiled in, PDEV_TRACE only builds its message
+// after the level and category checks pass.
+#ifndef PDEV_TRACE_ENABLED
+#ifdef NDEBUG
+#define PDEV_TRACE_ENABLED 0
+#else
+#define PDEV_TRACE_ENABLED 1
+#endif
+#endif
+enum class TraceLevel : uint8_t {
+    OFF,
+    INFO,
+    DEBUG,
+    VERBOSE
+};
+enum TraceCategory : uint8_t {
+    TRACE_LEXER = 1,
+    TRACE_PARSER = 2,
+    TRACE_SCOPES = 4,
+    TRACE_CALLS = 8,
+    TRACE_LOOPS = 16,
+    TRACE_ALL = 31
+};
 class Debugger {
 public:
-    static void enable(bool flag);
-    static void log(const std::string& message, int lineNumber = -1);
-    static void printContextTokens(Lexer& lexer, int contextSize = 5);
-};
\ No newline at end of file
+    static void configure(TraceLevel level, uint8_t categories);
+    static void setEcho(bool echo);
+    static bool enabled(TraceLevel level, uint8_t category) {
+        return level <= currentLevel && (currentCategories & category) != 0;
+    }
+    static void log(TraceLevel level, TraceCategory category, const std::string& message, int lineNumber = -1);
+    static void dump(std::ostream& out);
+    static void clear();
+    static void printContextTokens(const Lexer& lexer, int contextSize = 5);
+    static bool parseLevel(const std::string& name, TraceLevel& level);
+    static bool parseCategories(const std::string& names, uint8_t& categories);
+private:
+    static TraceLevel currentLevel;
+    static uint8_t currentCategories;
+};
+#if PDEV_TRACE_ENABLED
+#define PDEV_TRACE(level, category, message) \
+    do { \
+        if (Debugger::enabled(TraceLevel::level, category)) \
+            Debugger::log(TraceLevel::level, category, message); \
+    } while (0)
+#else
+#define PDEV_TRACE(level, category, message) do {} while (0)
+#endif
\ No newline at end of file
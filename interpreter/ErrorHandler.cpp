@@ -7,4 +7,21 @@ void ErrorHandler::throwError(const std::string& message, int lineNumber) {
     }
     oss << message;
     throw std::runtime_error(oss.str());
+}
+static std::string locatedMessage(const std::string& message, SourceLocation location) {
+    std::ostringstream oss;
+    if (location.line >= 0) {
+        oss << "Error at line " << location.line;
+        if (location.column >= 0)
+            oss << ", column " << location.column;
+        oss << ": ";
+    }
+    oss << message;
+    return oss.str();
+}
+void ErrorHandler::throwError(const std::string& message, SourceLocation location) {
+    throw std::runtime_error(locatedMessage(message, location));
+}
+void ErrorHandler::throwIncomplete(const std::string& message, SourceLocation location) {
+    throw IncompleteInputError(locatedMessage(message, location));
 }
\ No newline at end of file
@@ -1,7 +1,16 @@
 #pragma once
+#include "sourcemap.h"
 #include <string>
 #include <stdexcept>
+// Raised when the input ends in the middle of a token or statement, so a
+// streaming reader can tell "needs more text" apart from a real error.
+class IncompleteInputError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
 class ErrorHandler {
 public:
     static void throwError(const std::string& message, int lineNumber = -1);
+    static void throwError(const std::string& message, SourceLocation location);
+    static void throwIncomplete(const std::string& message, SourceLocation location);
 };
\ No newline at end of file
@@ -0,0 +1,8 @@
+#include "arithmetic.h"
+static bool trapping = false;
+void Arithmetic::setTrapOverflow(bool on) {
+    trapping = on;
+}
+bool Arithmetic::trapOverflow() {
+    return trapping;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+// 64-bit integer arithmetic shared by every engine. Results wrap around
+// (two's complement) instead of being undefined on overflow; with
+// trapping switched on, the engines report "Integer overflow" at the
+// operation instead. Each operation returns false when the exact result
+// does not fit, leaving the wrapped value in `result` either way.
+class Arithmetic {
+public:
+    static void setTrapOverflow(bool on);
+    static bool trapOverflow();
+    static bool add(int64_t a, int64_t b, int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_add_overflow(a, b, &result);
+#else
+        result = static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+        return ((a ^ result) & (b ^ result)) >= 0;
+#endif
+    }
+    static bool subtract(int64_t a, int64_t b, int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_sub_overflow(a, b, &result);
+#else
+        result = static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+        return ((a ^ b) & (a ^ result)) >= 0;
+#endif
+    }
+    static bool multiply(int64_t a, int64_t b, int64_t& result) {
+#if defined(__GNUC__) || defined(__clang__)
+        return !__builtin_mul_overflow(a, b, &result);
+#else
+        result = static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+        return a == 0 || (result / a == b && !(a == -1 && b == INT64_MIN));
+#endif
+    }
+    static bool negate(int64_t a, int64_t& result) {
+        return subtract(0, a, result);
+    }
+    // The divisor must not be zero; INT64_MIN / -1 is the one overflow.
+    static bool divide(int64_t a, int64_t b, int64_t& result) {
+        if (b == -1)
+            return negate(a, result);
+        result = a / b;
+        return true;
+    }
+};
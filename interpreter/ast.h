@@ -0,0 +1,114 @@
+#pragma once
+#include "hostfunctions.h"
+#include "sourcemap.h"
+#include "symbols.h"
+#include "value.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+struct Expr;
+struct Stmt;
+struct FunctionDef;
+using ExprPtr = std::unique_ptr<Expr>;
+using StmtPtr = std::unique_ptr<Stmt>;
+using Block = std::vector<StmtPtr>;
+enum class BinaryOp {
+    ADD, SUB, MUL, DIV,
+    EQUAL, NOT_EQUAL, LESS, LESS_EQUAL, GREATER, GREATER_EQUAL
+};
+struct VarRef {
+    enum Kind : uint8_t {
+        UNRESOLVED, LOCAL, GLOBAL
+    } kind = UNRESOLVED;
+    int index = -1;
+};
+struct Expr {
+    enum Kind {
+        NUMBER, STRING, VARIABLE, NEGATE, BINARY, CALL, CHECK_INT
+    } kind;
+    size_t position = 0;
+    int64_t number = 0;
+    Symbol symbol = 0;
+    VarRef ref;
+    BinaryOp op = BinaryOp::ADD;
+    ExprPtr left;
+    ExprPtr right;
+    std::vector<ExprPtr> args;
+    // Set by the optimizer and the resolver's type inference when the
+    // expression always yields an integer.
+    bool isInt = false;
+    // Call-site cache filled in by the evaluator; only valid while
+    // calleeVersion matches Program::functionVersion. `host` is set when
+    // no script function has the name.
+    mutable const FunctionDef* callee = nullptr;
+    mutable const HostFunctions::Entry* host = nullptr;
+    mutable uint32_t calleeVersion = 0;
+};
+// Clauses of a `parallel for` (see ParallelFor).
+struct Parallel {
+    // `reduce (+ total)`: every worker starts `total` at the operator's
+    // identity, and what they accumulate is combined into it afterwards.
+    struct Reduction {
+        BinaryOp op = BinaryOp::ADD;
+        Symbol name = 0;
+        VarRef ref;
+        size_t position = 0;
+    };
+    std::vector<Reduction> reductions;
+    // write() output may come out in any chunk order.
+    bool unordered = false;
+    // Set by the resolver to the first statement in the body that assigns
+    // a variable from outside the loop other than a reduction, since the
+    // assignment would only reach a worker's copy.
+    const Stmt* sharedStore = nullptr;
+};
+struct Stmt {
+    enum Kind {
+        ASSIGN, INCREMENT, DECREMENT, CALL, WRITE, IF, WHILE, DO_WHILE,
+        FOR, BREAK, CONTINUE, PASS, RETURN, BLOCK
+    } kind;
+    size_t position = 0;
+    Symbol name = 0;
+    VarRef ref;
+    ExprPtr expr;
+    StmtPtr init;
+    StmtPtr update;
+    Block body;
+    Block elseBody;
+    // Set by the resolver on a counted for loop: the condition compares a
+    // local induction variable with a loop-invariant bound and the update
+    // adds this constant to it. Zero for every other loop.
+    int step = 0;
+    // Set by the resolver on a return of a call inside a function, which
+    // reuses the caller's frame instead of nesting a new one.
+    bool tailCall = false;
+    // Only on a parallel for.
+    std::unique_ptr<Parallel> parallel;
+};
+struct FunctionDef {
+    Symbol name = 0;
+    std::vector<Symbol> params;
+    Block body;
+    size_t position = 0;
+    int frameSize = 0;
+    // No writes, no global reads or writes, and only calls to other pure
+    // functions: the result depends on the arguments alone.
+    bool pure = false;
+    // Every return yields an integer (see Resolver::inferTypes).
+    bool returnsInt = false;
+    // Set when the body came from a different window of the script than
+    // the code calling it (streaming mode); null means the program's map.
+    std::shared_ptr<const SourceMap> sourceMap;
+};
+struct Program {
+    Block statements;
+    std::unordered_map<Symbol, std::shared_ptr<FunctionDef>> functions;
+    // Bumped whenever a function is added or replaced, invalidating
+    // call-site caches.
+    uint32_t functionVersion = 1;
+    int frameSize = 0;
+    std::vector<Symbol> globals;
+    std::unordered_map<Symbol, int> globalIndex;
+};
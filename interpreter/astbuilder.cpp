@@ -0,0 +1,387 @@
+#include "astbuilder.h"
+#include "Debugger.h"
+#include "ErrorHandler.h"
+AstBuilder::AstBuilder(Lexer& lexer) : lexer(lexer) {
+    currentToken = this->lexer.nextToken();
+}
+void AstBuilder::error(const std::string& message) {
+    if (currentToken.type == Token::END)
+        ErrorHandler::throwIncomplete(message, lexer.getLocation(currentToken.position));
+    ErrorHandler::throwError(message, lexer.getLocation(currentToken.position));
+}
+void AstBuilder::consume(Token::Type expected) {
+    if (currentToken.type == expected)
+        currentToken = lexer.nextToken();
+    else
+        error("Expected token type " + std::to_string(expected) + " but found '" + std::string(lexer.text(currentToken)) + "'");
+}
+Program AstBuilder::build() {
+    Program result;
+    while (buildNext(result)) {}
+    return result;
+}
+// Parses one top-level statement or function definition into `target`,
+// so a streaming reader can execute a script piece by piece.
+bool AstBuilder::buildNext(Program& target) {
+    while (currentToken.type == Token::SEMICOLON)
+        consume(Token::SEMICOLON);
+    if (currentToken.type == Token::END)
+        return false;
+    program = &target;
+    if (StmtPtr stmt = statement())
+        target.statements.push_back(std::move(stmt));
+    program = nullptr;
+    return true;
+}
+size_t AstBuilder::position() const {
+    return currentToken.position;
+}
+bool AstBuilder::atEnd() const {
+    return currentToken.type == Token::END;
+}
+Block AstBuilder::block() {
+    Block stmts;
+    consume(Token::LBRACE);
+    while (currentToken.type != Token::RBRACE) {
+        if (currentToken.type == Token::END)
+            error("Unexpected end of input, expected '}'");
+        if (currentToken.type == Token::SEMICOLON) {
+            consume(Token::SEMICOLON);
+            continue;
+        }
+        if (StmtPtr stmt = statement())
+            stmts.push_back(std::move(stmt));
+    }
+    consume(Token::RBRACE);
+    return stmts;
+}
+StmtPtr AstBuilder::statement() {
+    size_t position = currentToken.position;
+    switch (currentToken.type) {
+        case Token::FUNCTION:
+            functionDefinition();
+            return nullptr;
+        case Token::IF:
+            return ifStatement();
+        case Token::FOR:
+            return forStatement();
+        case Token::WHILE:
+            return whileStatement();
+        case Token::DO:
+            return doStatement();
+        case Token::WRITE:
+            return writeStatement();
+        case Token::RETURN:
+            return returnStatement();
+        case Token::VAR:
+            return varStatement();
+        case Token::LBRACE: {
+            auto stmt = std::make_unique<Stmt>(Stmt{Stmt::BLOCK, position});
+            stmt->body = block();
+            return stmt;
+        }
+        case Token::BREAK:
+        case Token::CONTINUE:
+        case Token::PASS: {
+            Stmt::Kind kind = currentToken.type == Token::BREAK ? Stmt::BREAK
+                            : currentToken.type == Token::CONTINUE ? Stmt::CONTINUE : Stmt::PASS;
+            consume(currentToken.type);
+            consume(Token::SEMICOLON);
+            return std::make_unique<Stmt>(Stmt{kind, position});
+        }
+        default:
+            error("Unknown statement starting with token: " + std::string(lexer.text(currentToken)));
+            return nullptr;
+    }
+}
+void AstBuilder::functionDefinition() {
+    auto func = std::make_shared<FunctionDef>();
+    func->position = currentToken.position;
+    consume(Token::FUNCTION);
+    if (currentToken.type != Token::VAR)
+        error("Expected function name");
+    func->name = currentToken.symbol;
+    consume(Token::VAR);
+    consume(Token::LPAREN);
+    if (currentToken.type != Token::RPAREN) {
+        while (true) {
+            if (currentToken.type != Token::VAR)
+                error("Expected parameter name");
+            func->params.push_back(currentToken.symbol);
+            consume(Token::VAR);
+            if (currentToken.type == Token::COMMA)
+                consume(Token::COMMA);
+            else
+                break;
+        }
+    }
+    consume(Token::RPAREN);
+    func->body = block();
+    PDEV_TRACE(INFO, TRACE_CALLS, "Stored function '" + SymbolTable::name(func->name) + "' with " + std::to_string(func->params.size()) + " parameters");
+    program->functions[func->name] = std::move(func);
+}
+StmtPtr AstBuilder::ifStatement() {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::IF, currentToken.position});
+    consume(currentToken.type);
+    consume(Token::LPAREN);
+    stmt->expr = condition();
+    consume(Token::RPAREN);
+    stmt->body = block();
+    if (currentToken.type == Token::ELIF) {
+        stmt->elseBody.push_back(ifStatement());
+    } else if (currentToken.type == Token::ELSE) {
+        consume(Token::ELSE);
+        stmt->elseBody = block();
+    }
+    return stmt;
+}
+StmtPtr AstBuilder::forStatement(bool parallel) {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::FOR, currentToken.position});
+    consume(Token::FOR);
+    consume(Token::LPAREN);
+    if (currentToken.type != Token::SEMICOLON)
+        stmt->init = assignment();
+    consume(Token::SEMICOLON);
+    if (currentToken.type != Token::SEMICOLON)
+        stmt->expr = condition();
+    consume(Token::SEMICOLON);
+    if (currentToken.type != Token::RPAREN)
+        stmt->update = forUpdate();
+    consume(Token::RPAREN);
+    if (parallel)
+        parallelClauses(*stmt);
+    stmt->body = block();
+    return stmt;
+}
+// `reduce (+ name)` and `unordered`, in any order and number, between the
+// header and the body. Like `parallel` itself they are only words here, so
+// scripts can keep using them as names.
+void AstBuilder::parallelClauses(Stmt& loop) {
+    loop.parallel = std::make_unique<Parallel>();
+    while (currentToken.type == Token::VAR) {
+        std::string_view clause = lexer.text(currentToken);
+        if (clause == "unordered") {
+            consume(Token::VAR);
+            loop.parallel->unordered = true;
+            continue;
+        }
+        if (clause != "reduce")
+            error("Expected 'reduce', 'unordered' or '{' after parallel for");
+        consume(Token::VAR);
+        consume(Token::LPAREN);
+        Parallel::Reduction reduction;
+        reduction.position = currentToken.position;
+        if (currentToken.type != Token::OP || (lexer.text(currentToken) != "+" && lexer.text(currentToken) != "*"))
+            error("Expected '+' or '*' in reduce clause");
+        reduction.op = lexer.text(currentToken) == "+" ? BinaryOp::ADD : BinaryOp::MUL;
+        consume(Token::OP);
+        if (currentToken.type != Token::VAR)
+            error("Expected variable name in reduce clause");
+        reduction.name = currentToken.symbol;
+        for (const auto& other : loop.parallel->reductions) {
+            if (other.name == reduction.name)
+                error("Variable reduced twice: " + SymbolTable::name(reduction.name));
+        }
+        consume(Token::VAR);
+        consume(Token::RPAREN);
+        loop.parallel->reductions.push_back(reduction);
+    }
+}
+StmtPtr AstBuilder::whileStatement() {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::WHILE, currentToken.position});
+    consume(Token::WHILE);
+    consume(Token::LPAREN);
+    stmt->expr = condition();
+    consume(Token::RPAREN);
+    stmt->body = block();
+    return stmt;
+}
+StmtPtr AstBuilder::doStatement() {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::DO_WHILE, currentToken.position});
+    consume(Token::DO);
+    stmt->body = block();
+    consume(Token::WHILE);
+    consume(Token::LPAREN);
+    stmt->expr = condition();
+    consume(Token::RPAREN);
+    if (currentToken.type == Token::SEMICOLON)
+        consume(Token::SEMICOLON);
+    return stmt;
+}
+StmtPtr AstBuilder::writeStatement() {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::WRITE, currentToken.position});
+    consume(Token::WRITE);
+    consume(Token::LPAREN);
+    stmt->expr = expr();
+    consume(Token::RPAREN);
+    consume(Token::SEMICOLON);
+    return stmt;
+}
+StmtPtr AstBuilder::returnStatement() {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::RETURN, currentToken.position});
+    consume(Token::RETURN);
+    if (currentToken.type != Token::SEMICOLON)
+        stmt->expr = expr();
+    consume(Token::SEMICOLON);
+    return stmt;
+}
+StmtPtr AstBuilder::varStatement() {
+    Token next = lexer.peekToken();
+    if (next.type == Token::FOR && lexer.text(currentToken) == "parallel") {
+        consume(Token::VAR);
+        return forStatement(true);
+    }
+    StmtPtr stmt;
+    if (next.type == Token::ARROW) {
+        stmt = assignment();
+    } else if (next.type == Token::LPAREN) {
+        stmt = std::make_unique<Stmt>(Stmt{Stmt::CALL, currentToken.position});
+        Token name = currentToken;
+        consume(Token::VAR);
+        stmt->expr = call(name);
+    } else if (next.type == Token::INCREMENT || next.type == Token::DECREMENT) {
+        stmt = forUpdate();
+    } else {
+        error("Expected '->' or '(' after variable");
+    }
+    consume(Token::SEMICOLON);
+    return stmt;
+}
+StmtPtr AstBuilder::assignment() {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::ASSIGN, currentToken.position});
+    if (currentToken.type != Token::VAR)
+        error("Expected variable name in assignment");
+    stmt->name = currentToken.symbol;
+    consume(Token::VAR);
+    consume(Token::ARROW);
+    stmt->expr = expr();
+    return stmt;
+}
+StmtPtr AstBuilder::forUpdate() {
+    if (currentToken.type != Token::VAR)
+        error("Invalid update expression in for loop");
+    if (lexer.peekToken().type == Token::ARROW)
+        return assignment();
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::INCREMENT, currentToken.position});
+    stmt->name = currentToken.symbol;
+    consume(Token::VAR);
+    if (currentToken.type == Token::INCREMENT) {
+        consume(Token::INCREMENT);
+    } else if (currentToken.type == Token::DECREMENT) {
+        stmt->kind = Stmt::DECREMENT;
+        consume(Token::DECREMENT);
+    } else {
+        error("Invalid update expression in for loop");
+    }
+    return stmt;
+}
+ExprPtr AstBuilder::binary(BinaryOp op, ExprPtr left, ExprPtr right, size_t position) {
+    auto node = std::make_unique<Expr>(Expr{Expr::BINARY, position});
+    node->op = op;
+    node->left = std::move(left);
+    node->right = std::move(right);
+    return node;
+}
+ExprPtr AstBuilder::condition() {
+    ExprPtr left = expr();
+    BinaryOp op;
+    switch (currentToken.type) {
+        case Token::EQUAL: op = BinaryOp::EQUAL; break;
+        case Token::NOT_EQUAL: op = BinaryOp::NOT_EQUAL; break;
+        case Token::LESS: op = BinaryOp::LESS; break;
+        case Token::LESS_EQUAL: op = BinaryOp::LESS_EQUAL; break;
+        case Token::GREATER: op = BinaryOp::GREATER; break;
+        case Token::GREATER_EQUAL: op = BinaryOp::GREATER_EQUAL; break;
+        default: return left;
+    }
+    size_t position = currentToken.position;
+    consume(currentToken.type);
+    return binary(op, std::move(left), expr(), position);
+}
+ExprPtr AstBuilder::expr() {
+    ExprPtr result = term();
+    while (currentToken.type == Token::OP && (lexer.text(currentToken) == "+" || lexer.text(currentToken) == "-")) {
+        BinaryOp op = lexer.text(currentToken) == "+" ? BinaryOp::ADD : BinaryOp::SUB;
+        size_t position = currentToken.position;
+        consume(Token::OP);
+        result = binary(op, std::move(result), term(), position);
+    }
+    return result;
+}
+ExprPtr AstBuilder::term() {
+    ExprPtr result = factor();
+    while (currentToken.type == Token::OP && (lexer.text(currentToken) == "*" || lexer.text(currentToken) == "/")) {
+        BinaryOp op = lexer.text(currentToken) == "*" ? BinaryOp::MUL : BinaryOp::DIV;
+        size_t position = currentToken.position;
+        consume(Token::OP);
+        result = binary(op, std::move(result), factor(), position);
+    }
+    return result;
+}
+ExprPtr AstBuilder::factor() {
+    size_t position = currentToken.position;
+    switch (currentToken.type) {
+        case Token::LPAREN: {
+            consume(Token::LPAREN);
+            ExprPtr inner = expr();
+            consume(Token::RPAREN);
+            return inner;
+        }
+        case Token::NUM: {
+            auto node = std::make_unique<Expr>(Expr{Expr::NUMBER, position});
+            node->number = lexer.number(currentToken);
+            consume(Token::NUM);
+            return node;
+        }
+        case Token::TRUE:
+        case Token::FALSE: {
+            auto node = std::make_unique<Expr>(Expr{Expr::NUMBER, position});
+            node->number = currentToken.type == Token::TRUE ? 1 : 0;
+            consume(currentToken.type);
+            return node;
+        }
+        case Token::STRING: {
+            auto node = std::make_unique<Expr>(Expr{Expr::STRING, position});
+            node->symbol = currentToken.symbol;
+            consume(Token::STRING);
+            return node;
+        }
+        case Token::VAR: {
+            Token name = currentToken;
+            consume(Token::VAR);
+            if (currentToken.type == Token::LPAREN)
+                return call(name);
+            auto node = std::make_unique<Expr>(Expr{Expr::VARIABLE, position});
+            node->symbol = name.symbol;
+            return node;
+        }
+        case Token::OP:
+            if (lexer.text(currentToken) == "-") {
+                consume(Token::OP);
+                auto node = std::make_unique<Expr>(Expr{Expr::NEGATE, position});
+                node->left = factor();
+                return node;
+            }
+            break;
+        default:
+            break;
+    }
+    error("Unexpected token in factor: " + std::string(lexer.text(currentToken)));
+    return nullptr;
+}
+ExprPtr AstBuilder::call(const Token& name) {
+    auto node = std::make_unique<Expr>(Expr{Expr::CALL, name.position});
+    node->symbol = name.symbol;
+    consume(Token::LPAREN);
+    if (currentToken.type != Token::RPAREN) {
+        while (true) {
+            node->args.push_back(expr());
+            if (currentToken.type == Token::COMMA)
+                consume(Token::COMMA);
+            else
+                break;
+        }
+    }
+    consume(Token::RPAREN);
+    return node;
+}
@@ -0,0 +1,36 @@
+#pragma once
+#include "ast.h"
+#include "lexer.h"
+class AstBuilder {
+public:
+    AstBuilder(Lexer& lexer);
+    Program build();
+    bool buildNext(Program& target);
+    size_t position() const;
+    bool atEnd() const;
+private:
+    Lexer& lexer;
+    Token currentToken;
+    Program* program = nullptr;
+    void consume(Token::Type expected);
+    void error(const std::string& message);
+    StmtPtr statement();
+    Block block();
+    void functionDefinition();
+    StmtPtr ifStatement();
+    StmtPtr forStatement(bool parallel = false);
+    void parallelClauses(Stmt& loop);
+    StmtPtr whileStatement();
+    StmtPtr doStatement();
+    StmtPtr writeStatement();
+    StmtPtr returnStatement();
+    StmtPtr varStatement();
+    StmtPtr assignment();
+    StmtPtr forUpdate();
+    ExprPtr condition();
+    ExprPtr expr();
+    ExprPtr term();
+    ExprPtr factor();
+    ExprPtr call(const Token& name);
+    ExprPtr binary(BinaryOp op, ExprPtr left, ExprPtr right, size_t position);
+};
@@ -0,0 +1,192 @@
+#include "astprinter.h"
+#include <algorithm>
+#include <vector>
+static const char* operatorText(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return "+";
+        case BinaryOp::SUB: return "-";
+        case BinaryOp::MUL: return "*";
+        case BinaryOp::DIV: return "/";
+        case BinaryOp::EQUAL: return "==";
+        case BinaryOp::NOT_EQUAL: return "!=";
+        case BinaryOp::LESS: return "<";
+        case BinaryOp::LESS_EQUAL: return "<=";
+        case BinaryOp::GREATER: return ">";
+        case BinaryOp::GREATER_EQUAL: return ">=";
+    }
+    return "?";
+}
+static void printExpr(const Expr& expr, std::ostream& out) {
+    switch (expr.kind) {
+        case Expr::NUMBER:
+            out << expr.number;
+            return;
+        case Expr::STRING:
+            out << '"' << SymbolTable::name(expr.symbol) << '"';
+            return;
+        case Expr::VARIABLE:
+            out << SymbolTable::name(expr.symbol);
+            return;
+        case Expr::NEGATE:
+            out << "-";
+            printExpr(*expr.left, out);
+            return;
+        case Expr::CHECK_INT:
+            // Written as the identity it replaced so the dump still runs.
+            out << "(";
+            printExpr(*expr.left, out);
+            out << " + 0)";
+            return;
+        case Expr::CALL:
+            out << SymbolTable::name(expr.symbol) << "(";
+            for (size_t i = 0; i < expr.args.size(); ++i) {
+                if (i > 0)
+                    out << ", ";
+                printExpr(*expr.args[i], out);
+            }
+            out << ")";
+            return;
+        case Expr::BINARY:
+            out << "(";
+            printExpr(*expr.left, out);
+            out << " " << operatorText(expr.op) << " ";
+            printExpr(*expr.right, out);
+            out << ")";
+            return;
+    }
+}
+// Conditions already sit inside parentheses, so a top-level binary
+// expression is written without its own pair.
+static void printCondition(const Expr& expr, std::ostream& out) {
+    if (expr.kind != Expr::BINARY) {
+        printExpr(expr, out);
+        return;
+    }
+    printExpr(*expr.left, out);
+    out << " " << operatorText(expr.op) << " ";
+    printExpr(*expr.right, out);
+}
+static void printBlock(const Block& block, std::ostream& out, int depth);
+static void printSimple(const Stmt& stmt, std::ostream& out) {
+    switch (stmt.kind) {
+        case Stmt::ASSIGN:
+            out << SymbolTable::name(stmt.name) << " -> ";
+            printExpr(*stmt.expr, out);
+            break;
+        case Stmt::INCREMENT:
+            out << SymbolTable::name(stmt.name) << "++";
+            break;
+        case Stmt::DECREMENT:
+            out << SymbolTable::name(stmt.name) << "--";
+            break;
+        default:
+            break;
+    }
+}
+static void printStmt(const Stmt& stmt, std::ostream& out, int depth) {
+    std::string indent(depth * 4, ' ');
+    out << indent;
+    switch (stmt.kind) {
+        case Stmt::ASSIGN:
+        case Stmt::INCREMENT:
+        case Stmt::DECREMENT:
+            printSimple(stmt, out);
+            out << ";\n";
+            return;
+        case Stmt::CALL:
+            printExpr(*stmt.expr, out);
+            out << ";\n";
+            return;
+        case Stmt::WRITE:
+            out << "write(";
+            printExpr(*stmt.expr, out);
+            out << ");\n";
+            return;
+        case Stmt::IF:
+            out << "if (";
+            printCondition(*stmt.expr, out);
+            out << ") ";
+            printBlock(stmt.body, out, depth);
+            if (!stmt.elseBody.empty()) {
+                out << indent << "else ";
+                printBlock(stmt.elseBody, out, depth);
+            }
+            return;
+        case Stmt::WHILE:
+            out << "while (";
+            printCondition(*stmt.expr, out);
+            out << ") ";
+            printBlock(stmt.body, out, depth);
+            return;
+        case Stmt::DO_WHILE:
+            out << "do ";
+            printBlock(stmt.body, out, depth);
+            out << indent << "while (";
+            printCondition(*stmt.expr, out);
+            out << ");\n";
+            return;
+        case Stmt::FOR:
+            if (stmt.parallel)
+                out << "parallel ";
+            out << "for (";
+            if (stmt.init)
+                printSimple(*stmt.init, out);
+            out << "; ";
+            if (stmt.expr)
+                printCondition(*stmt.expr, out);
+            out << "; ";
+            if (stmt.update)
+                printSimple(*stmt.update, out);
+            out << ") ";
+            if (stmt.parallel) {
+                for (const auto& reduction : stmt.parallel->reductions)
+                    out << "reduce (" << operatorText(reduction.op) << " " << SymbolTable::name(reduction.name) << ") ";
+                if (stmt.parallel->unordered)
+                    out << "unordered ";
+            }
+            printBlock(stmt.body, out, depth);
+            return;
+        case Stmt::BREAK:
+            out << "break;\n";
+            return;
+        case Stmt::CONTINUE:
+            out << "continue;\n";
+            return;
+        case Stmt::PASS:
+            out << "pass;\n";
+            return;
+        case Stmt::RETURN:
+            out << "return";
+            if (stmt.expr) {
+                out << " ";
+                printExpr(*stmt.expr, out);
+            }
+            out << ";\n";
+            return;
+        case Stmt::BLOCK:
+            printBlock(stmt.body, out, depth);
+            return;
+    }
+}
+static void printBlock(const Block& block, std::ostream& out, int depth) {
+    out << "{\n";
+    for (const auto& stmt : block)
+        printStmt(*stmt, out, depth + 1);
+    out << std::string(depth * 4, ' ') << "}\n";
+}
+void printProgram(const Program& program, std::ostream& out) {
+    std::vector<const FunctionDef*> functions;
+    for (const auto& [name, func] : program.functions)
+        functions.push_back(func.get());
+    std::sort(functions.begin(), functions.end(),
+              [](const FunctionDef* a, const FunctionDef* b) { return a->position < b->position; });
+    for (const FunctionDef* func : functions) {
+        out << "function " << SymbolTable::name(func->name) << "(";
+        for (size_t i = 0; i < func->params.size(); ++i)
+            out << (i > 0 ? ", " : "") << SymbolTable::name(func->params[i]);
+        out << ") ";
+        printBlock(func->body, out, 0);
+    }
+    for (const auto& stmt : program.statements)
+        printStmt(*stmt, out, 0);
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include "ast.h"
+#include <ostream>
+// Writes a program back out as P-Dev source, for inspecting what the
+// optimizer left behind.
+void printProgram(const Program& program, std::ostream& out);
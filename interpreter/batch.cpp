@@ -0,0 +1,107 @@
+#include "batch.h"
+#include "Debugger.h"
+#include "scriptfile.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+namespace fs = std::filesystem;
+bool BatchRunner::collect(const std::string& argument, std::vector<std::string>& paths, std::string& error) {
+    if (!argument.empty() && argument[0] == '@') {
+        fs::path manifest = argument.substr(1);
+        std::ifstream list(manifest);
+        if (!list) {
+            error = "Failed to open manifest: " + manifest.string();
+            return false;
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            line.erase(std::find(line.begin(), line.end(), '#'), line.end());
+            size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos)
+                continue;
+            line = line.substr(first, line.find_last_not_of(" \t\r") + 1 - first);
+            fs::path entry = line;
+            if (entry.is_relative())
+                entry = manifest.parent_path() / entry;
+            if (!collect(entry.string(), paths, error))
+                return false;
+        }
+        return true;
+    }
+    std::error_code failure;
+    if (!fs::is_directory(argument, failure)) {
+        paths.push_back(argument);
+        return true;
+    }
+    std::vector<std::string> scripts;
+    for (const auto& entry : fs::directory_iterator(argument, failure)) {
+        if (entry.path().extension() == ".pdev" && !entry.is_directory(failure))
+            scripts.push_back(entry.path().string());
+    }
+    if (failure) {
+        error = "Failed to list directory: " + argument;
+        return false;
+    }
+    std::sort(scripts.begin(), scripts.end());
+    paths.insert(paths.end(), scripts.begin(), scripts.end());
+    return true;
+}
+void BatchRunner::runOne(Result& result) {
+    auto start = std::chrono::steady_clock::now();
+    ScriptFile script;
+    if (!script.open(result.path)) {
+        result.errors = "Failed to open file: " + result.path + "\n";
+        result.status = 1;
+    } else {
+        std::ostringstream errors;
+        Debugger::clear();
+        {
+            OutputChannel output(result.output);
+            if (!runSource(script.text(), engine, output, errors))
+                result.status = 1;
+        }
+        result.errors = errors.str();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+int BatchRunner::run(const std::vector<std::string>& paths, OutputChannel& output, std::ostream& summary) {
+    auto start = std::chrono::steady_clock::now();
+    finished.assign(paths.size(), Result());
+    for (size_t i = 0; i < paths.size(); ++i)
+        finished[i].path = paths[i];
+    std::vector<uint8_t> done(paths.size(), 0);
+    std::mutex outputLock;
+    size_t nextOutput = 0;
+    ThreadPool::shared().run(paths.size(), [&](size_t index, size_t) {
+        runOne(finished[index]);
+        std::lock_guard<std::mutex> guard(outputLock);
+        done[index] = 1;
+        for (; nextOutput < paths.size() && done[nextOutput]; ++nextOutput) {
+            Result& result = finished[nextOutput];
+            output.write("==> " + result.path + " <==\n");
+            output.write(result.output);
+            output.flush();
+            std::string().swap(result.output);
+            std::cerr << result.errors << std::flush;
+        }
+    });
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    size_t failed = 0;
+    double busy = 0;
+    for (const Result& result : finished) {
+        failed += result.status != 0;
+        busy += result.seconds;
+    }
+    summary << "Batch: " << finished.size() << " scripts, " << failed << " failed, "
+            << ThreadPool::shared().workers() << " threads\n";
+    for (const Result& result : finished)
+        summary << "Script " << result.path << ": " << (result.status ? "failed" : "ok") << ", "
+                << result.seconds * 1000 << " ms\n";
+    summary << "Batch wall time: " << wall * 1000 << " ms (" << busy * 1000 << " ms across scripts)" << std::endl;
+    return failed ? 1 : 0;
+}
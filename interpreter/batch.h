@@ -0,0 +1,34 @@
+#pragma once
+#include "interpreter.h"
+#include "output.h"
+#include <ostream>
+#include <string>
+#include <vector>
+// Runs many scripts side by side on the shared ThreadPool, each on an
+// interpreter of its own. A script's output is captured while it runs and
+// written out whole, under a header naming the script, once it and every
+// script listed before it have finished; its errors follow on stderr. The
+// summary gives each script's status and wall time.
+class BatchRunner {
+public:
+    struct Result {
+        std::string path;
+        std::string output;
+        std::string errors;
+        int status = 0;
+        double seconds = 0;
+    };
+    // Expands one argument into scripts: a directory contributes its .pdev
+    // files in name order, `@file` the paths listed in a manifest one per
+    // line (relative to the manifest, `#` starts a comment), and anything
+    // else is taken as a script path.
+    static bool collect(const std::string& argument, std::vector<std::string>& paths, std::string& error);
+    explicit BatchRunner(Engine engine) : engine(engine) {}
+    // Returns 0 when every script succeeded and 1 otherwise.
+    int run(const std::vector<std::string>& paths, OutputChannel& output, std::ostream& summary);
+    const std::vector<Result>& results() const { return finished; }
+private:
+    Engine engine;
+    std::vector<Result> finished;
+    void runOne(Result& result);
+};
@@ -0,0 +1,378 @@
+#include "benchmark.h"
+#include "astbuilder.h"
+#include "compiler.h"
+#include "evaluator.h"
+#include "hostfunctions.h"
+#include "jit.h"
+#include "lexer.h"
+#include "memo.h"
+#include "memory.h"
+#include "optimizer.h"
+#include "output.h"
+#include "resolver.h"
+#include "programcache.h"
+#include "scriptfile.h"
+#include "session.h"
+#include "vm.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <unordered_map>
+#include <variant>
+using BenchClock = std::chrono::steady_clock;
+static std::string generateLexerWorkload(size_t targetBytes, bool commentHeavy) {
+    std::string out;
+    out.reserve(targetBytes + 1024);
+    std::string banner = commentHeavy ? std::string(6, ' ') + std::string(90, '=') + "\n" : "";
+    for (int i = 0; out.size() < targetBytes; ++i) {
+        std::string n = std::to_string(i);
+        out += "/* generated block " + n + "\n   scoring helpers for record batches */\n";
+        if (commentHeavy) {
+            out += "/*\n" + banner + "   Generated by the batch exporter. Each record scorer below is emitted from the\n"
+                   "   upstream schema and must not be edited by hand; regenerate instead.\n" + banner + "*/\n";
+            out += "// " + std::string(100, '-') + "\n" + std::string(32, ' ') + "\n";
+            out += "note_" + n + " -> \"" + std::string(120, 'x') + "\";\n";
+        }
+        out += "function score_record_" + n + "(record_index, weight_factor) {\n";
+        out += "        // accumulate the weighted score for this record\n";
+        out += "        accumulated_total -> record_index * weight_factor + " + n + ";\n";
+        out += "        if (accumulated_total >= 1000000) {\n";
+        out += "                write(\"overflowing accumulated total in block " + n + "\");\n";
+        out += "        } elif (accumulated_total == 0) {\n";
+        out += "                pass;\n";
+        out += "        }\n";
+        out += "        for (counter -> 0; counter < 128; counter++) {\n";
+        out += "                accumulated_total -> accumulated_total - counter / 2;\n";
+        out += "        }\n";
+        out += "        return accumulated_total;\n";
+        out += "}\n\n";
+    }
+    return out;
+}
+static void benchLexerInput(const std::string& label, std::string_view input) {
+    double megabytes = input.size() / (1024.0 * 1024.0);
+    std::cout << "Lexer throughput over " << megabytes << " MB (" << label << ")\n";
+    for (ScanMode mode : {ScanMode::SCALAR, ScanMode::SSE2, ScanMode::AVX2}) {
+        if (resolveScanMode(mode) != mode) {
+            std::cout << "  " << scanModeName(mode) << ": unavailable on this CPU/build\n";
+            continue;
+        }
+        size_t tokens = 0;
+        int runs = 0;
+        auto start = BenchClock::now();
+        std::chrono::duration<double> elapsed{};
+        do {
+            Lexer lexer(input, mode);
+            tokens = lexer.getTokens().size();
+            ++runs;
+            elapsed = BenchClock::now() - start;
+        } while (elapsed.count() < 1.0 && runs < 1000);
+        double seconds = elapsed.count() / runs;
+        std::cout << "  " << scanModeName(mode) << ": " << megabytes / seconds << " MB/s, "
+                  << tokens << " tokens, " << seconds * 1000.0 << " ms per pass\n";
+    }
+}
+static int benchLexer(const std::string& scriptPath) {
+    if (!scriptPath.empty()) {
+        ScriptFile script;
+        if (!script.open(scriptPath))
+            throw std::runtime_error("Failed to open file: " + scriptPath);
+        benchLexerInput(scriptPath, script.text());
+        return 0;
+    }
+    benchLexerInput("generated, code-dense", generateLexerWorkload(16 << 20, false));
+    benchLexerInput("generated, comment-heavy", generateLexerWorkload(16 << 20, true));
+    return 0;
+}
+using VariantValue = std::variant<int, std::string>;
+// Mirrors the value traffic of one scripted call: read a variable out of a
+// scope, pass it as two arguments, and store one back through a by-value
+// parameter.
+template <typename V>
+static void storeByValue(std::unordered_map<Symbol, V>& scope, Symbol name, V value) {
+    scope[name] = value;
+}
+template <typename V>
+static void benchValueTraffic(const char* label, const V& seed) {
+    const int iterations = 1000000;
+    std::unordered_map<Symbol, V> scope;
+    scope[0] = seed;
+    scope[1] = seed;
+    std::vector<V> args;
+    args.reserve(2);
+    uint64_t allocationsBefore = HeapStats::allocations();
+    auto start = BenchClock::now();
+    for (int i = 0; i < iterations; ++i) {
+        V looked = scope.at(0);
+        args.clear();
+        args.push_back(looked);
+        args.push_back(looked);
+        storeByValue(scope, 1, args[0]);
+    }
+    std::chrono::duration<double> elapsed = BenchClock::now() - start;
+    double allocations = static_cast<double>(HeapStats::allocations() - allocationsBefore) / iterations;
+    std::cout << "  " << label << ": " << allocations << " allocations/iteration, "
+              << elapsed.count() * 1e9 / iterations << " ns/iteration\n";
+}
+static uint64_t countScriptAllocations(const std::string& source, bool useVm) {
+    uint64_t before = HeapStats::allocations();
+    Lexer lexer(source);
+    Program program = AstBuilder(lexer).build();
+    Optimizer(program).optimize();
+    Resolver(program).resolve();
+    if (useVm) {
+        CompiledProgram compiled = Compiler(program).compile();
+        VM(compiled, lexer).run();
+    } else {
+        Evaluator(program, lexer).run();
+    }
+    return HeapStats::allocations() - before;
+}
+static std::string valueLoopScript(int iterations) {
+    return "function pick(a, b) { return a; }\n"
+           "s -> \"a string literal that is too long for any small-string buffer\";\n"
+           "for (i -> 0; i < " + std::to_string(iterations) + "; i++) { t -> s; u -> pick(t, s); }\n";
+}
+static int benchValues() {
+    std::string shortText = "short";
+    std::string longText(48, 'x');
+    std::cout << "Value copies (variable read, two arguments, by-value store)\n";
+    benchValueTraffic("variant int", VariantValue(7));
+    benchValueTraffic("variant short string", VariantValue(shortText));
+    benchValueTraffic("variant long string", VariantValue(longText));
+    benchValueTraffic("tagged int", Value(7));
+    benchValueTraffic("tagged short string", Value(shortText));
+    benchValueTraffic("tagged long string", Value(longText));
+    std::cout << "Script loop passing a string through a call\n";
+    const int small = 10000, large = 110000;
+    countScriptAllocations(valueLoopScript(small), false);
+    for (bool useVm : {false, true}) {
+        uint64_t base = countScriptAllocations(valueLoopScript(small), useVm);
+        uint64_t total = countScriptAllocations(valueLoopScript(large), useVm);
+        double perIteration = (static_cast<double>(total) - static_cast<double>(base)) / (large - small);
+        std::cout << "  " << (useVm ? "vm" : "ast") << ": " << perIteration << " allocations/iteration\n";
+    }
+    return 0;
+}
+#ifdef _WIN32
+static const char* const nullDevice = "NUL";
+#else
+static const char* const nullDevice = "/dev/null";
+#endif
+static void benchOutputChannel(const char* label, OutputChannel::Flush policy, size_t threshold, int lines) {
+    OutputChannel output(-1, policy, threshold);
+    if (!output.redirect(nullDevice))
+        throw std::runtime_error(std::string("Failed to open ") + nullDevice);
+    auto start = BenchClock::now();
+    for (int i = 0; i < lines; ++i)
+        output.writeLine(Value(i));
+    output.flush();
+    std::chrono::duration<double> elapsed = BenchClock::now() - start;
+    std::cout << "  " << label << ": " << elapsed.count() * 1e9 / lines << " ns/line\n";
+}
+static int benchOutput() {
+    const int lines = 2000000;
+    std::cout << "write() of " << lines << " integer lines to " << nullDevice << "\n";
+    {
+        std::ofstream stream(nullDevice);
+        auto start = BenchClock::now();
+        for (int i = 0; i < lines; ++i)
+            stream << i << std::endl;
+        std::chrono::duration<double> elapsed = BenchClock::now() - start;
+        std::cout << "  ostream with endl: " << elapsed.count() * 1e9 / lines << " ns/line\n";
+    }
+    benchOutputChannel("channel, line flush", OutputChannel::Flush::LINE, OutputChannel::BUFFER_SIZE, lines);
+    benchOutputChannel("channel, 4096-byte flush", OutputChannel::Flush::BYTES, 4096, lines);
+    benchOutputChannel("channel, flush at exit", OutputChannel::Flush::EXIT, OutputChannel::BUFFER_SIZE, lines);
+    return 0;
+}
+// Feeds many small snippets to one session, the way an embedding host
+// would, against a fresh parse of the accumulated program per snippet.
+static int benchSession() {
+    const int snippets = 20000;
+    std::string sink;
+    OutputChannel output(sink);
+    std::cout << "Evaluating " << snippets << " snippets that build on earlier state\n";
+    {
+        Session session(output);
+        session.eval("function scale(v, k) { return v * k; }\ntotal -> 0;\n");
+        auto start = BenchClock::now();
+        for (int i = 0; i < snippets; ++i)
+            session.eval("v" + std::to_string(i % 64) + " -> scale(" + std::to_string(i) + ", 3); total -> total + 1;");
+        std::chrono::duration<double> elapsed = BenchClock::now() - start;
+        std::cout << "  session: " << snippets / elapsed.count() << " snippets/s\n";
+    }
+    {
+        std::string program = "function scale(v, k) { return v * k; }\ntotal -> 0;\n";
+        const int replayed = snippets / 20;
+        auto start = BenchClock::now();
+        for (int i = 0; i < replayed; ++i) {
+            program += "v" + std::to_string(i % 64) + " -> scale(" + std::to_string(i) + ", 3); total -> total + 1;\n";
+            Lexer lexer(program);
+            Program parsed = AstBuilder(lexer).build();
+            Optimizer(parsed).optimize();
+            Resolver(parsed).resolve();
+            Evaluator(parsed, lexer, output).run();
+        }
+        std::chrono::duration<double> elapsed = BenchClock::now() - start;
+        std::cout << "  re-run whole program: " << replayed / elapsed.count() << " snippets/s (over " << replayed << " snippets)\n";
+    }
+    return 0;
+}
+// Startup up to the first executed instruction: compile from source and
+// write the cache (cold), or map and decode a valid cache (warm).
+static double timeStartup(const std::string& scriptPath, const std::string& cachePath, bool warm) {
+    auto start = BenchClock::now();
+    ScriptFile script;
+    if (!script.open(scriptPath))
+        throw std::runtime_error("Failed to open file: " + scriptPath);
+    CompiledProgram compiled;
+    if (!warm || !ProgramCache::load(cachePath, script.text(), compiled)) {
+        Lexer lexer(script.text());
+        Program program = AstBuilder(lexer).build();
+        Optimizer(program).optimize();
+        Resolver(program).resolve();
+        compiled = Compiler(program).compile();
+        ProgramCache::store(cachePath, script.text(), compiled);
+    }
+    SourceMap sourceMap(script.text(), scanKernels(ScanMode::AUTO));
+    std::chrono::duration<double> elapsed = BenchClock::now() - start;
+    return elapsed.count() * 1000.0;
+}
+static int benchCache(std::string scriptPath) {
+    std::filesystem::path generated;
+    if (scriptPath.empty()) {
+        generated = std::filesystem::temp_directory_path() / "pdev-cache-bench.pdev";
+        std::ofstream(generated, std::ios::binary) << generateLexerWorkload(8 << 20, false);
+        scriptPath = generated.string();
+    }
+    std::string cachePath = ProgramCache::pathFor(scriptPath);
+    const int runs = 5;
+    double cold = 0, warm = 0;
+    for (int i = 0; i < runs; ++i) {
+        cold += timeStartup(scriptPath, cachePath, false);
+        warm += timeStartup(scriptPath, cachePath, true);
+    }
+    std::cout << "Startup for " << scriptPath << " (" << std::filesystem::file_size(scriptPath) / 1024 << " KB source, "
+              << std::filesystem::file_size(cachePath) / 1024 << " KB cache)\n"
+              << "  cold (lex, parse, resolve, compile, store): " << cold / runs << " ms\n"
+              << "  warm (map and decode cache): " << warm / runs << " ms\n";
+    if (!generated.empty()) {
+        std::filesystem::remove(generated);
+        std::filesystem::remove(cachePath);
+    }
+    return 0;
+}
+// Integer-only recursion and loops on the vm, interpreted and native.
+// Memoization is switched off so that fib really makes every call.
+static double timeVm(const std::string& source, bool jit, std::string& sink) {
+    Lexer lexer(source);
+    Program program = AstBuilder(lexer).build();
+    Optimizer(program).optimize();
+    Resolver(program).resolve();
+    CompiledProgram compiled = Compiler(program).compile();
+    OutputChannel output(sink);
+    Jit::setEnabled(jit);
+    auto start = BenchClock::now();
+    VM(compiled, lexer, output).run();
+    output.flush();
+    std::chrono::duration<double> elapsed = BenchClock::now() - start;
+    return elapsed.count() * 1000.0;
+}
+static int benchJit() {
+    if (!Jit::available()) {
+        std::cerr << "The native tier is not available on this platform\n";
+        return 1;
+    }
+    const std::pair<const char*, std::string> workloads[] = {
+        {"recursion, fib(30)",
+         "function fib(n) {\n    if (n < 2) {\n        return n;\n    }\n    return fib(n - 1) + fib(n - 2);\n}\n"
+         "write(fib(30));\n"},
+        {"nested loops, 10M iterations",
+         "function work(n) {\n    s -> 0;\n    for (i -> 0; i < n; i++) {\n        for (j -> 0; j < 1000; j++) {\n"
+         "            s -> s + (i * j) / 7 - j;\n        }\n    }\n    return s;\n}\nwrite(work(10000));\n"},
+    };
+    bool wasEnabled = Jit::enabled();
+    size_t memoCapacity = MemoTable::capacity();
+    MemoTable::setCapacity(0);
+    for (const auto& [label, source] : workloads) {
+        std::string interpreted, native;
+        double off = timeVm(source, false, interpreted);
+        double on = timeVm(source, true, native);
+        std::cout << label << "\n"
+                  << "  vm: " << off << " ms\n"
+                  << "  vm + jit: " << on << " ms" << (interpreted == native ? "" : " (output differs!)") << "\n";
+    }
+    MemoTable::setCapacity(memoCapacity);
+    Jit::setEnabled(wasEnabled);
+    return 0;
+}
+// The same two-argument function registered by the host and written in the
+// script, called from a top-level loop. The loop without calls is timed
+// too and taken off, leaving the cost of a call. Memoization and the jit
+// are off so that every script call is interpreted.
+static double timeCalls(const std::string& source, bool useVm, int calls) {
+    Lexer lexer(source);
+    Program program = AstBuilder(lexer).build();
+    Optimizer(program).optimize();
+    Resolver(program).resolve();
+    std::string sink;
+    OutputChannel output(sink);
+    auto start = BenchClock::now();
+    if (useVm) {
+        CompiledProgram compiled = Compiler(program).compile();
+        VM(compiled, lexer, output).run();
+    } else {
+        Evaluator(program, lexer, output).run();
+    }
+    std::chrono::duration<double> elapsed = BenchClock::now() - start;
+    return elapsed.count() * 1e9 / calls;
+}
+static int benchHostCalls() {
+    const int calls = 2000000;
+    HostFunctions::define("hostAdd", 2, [](HostFunctions::Arguments args) {
+        return Value(args[0].asInt() + args[1].asInt());
+    });
+    const std::string loop = "s -> 0;\nfor (i -> 0; i < " + std::to_string(calls) + "; i++) {\n    s -> ";
+    const std::string end = ";\n}\nwrite(s);\n";
+    const std::string scriptAdd = "function scriptAdd(a, b) {\n    return a + b;\n}\n";
+    bool wasEnabled = Jit::enabled();
+    size_t memoCapacity = MemoTable::capacity();
+    Jit::setEnabled(false);
+    MemoTable::setCapacity(0);
+    std::cout << calls << " calls of a two-argument add\n";
+    for (bool useVm : {false, true}) {
+        double empty = timeCalls(loop + "s + i" + end, useVm, calls);
+        double host = timeCalls(loop + "hostAdd(s, i)" + end, useVm, calls);
+        double script = timeCalls(scriptAdd + loop + "scriptAdd(s, i)" + end, useVm, calls);
+        std::cout << (useVm ? "vm" : "ast") << "\n"
+                  << "  host function: " << host - empty << " ns per call\n"
+                  << "  script function: " << script - empty << " ns per call\n";
+    }
+    MemoTable::setCapacity(memoCapacity);
+    Jit::setEnabled(wasEnabled);
+    return 0;
+}
+int runBenchmark(const std::string& name, const std::string& scriptPath) {
+    try {
+        if (name == "lexer")
+            return benchLexer(scriptPath);
+        if (name == "values")
+            return benchValues();
+        if (name == "output")
+            return benchOutput();
+        if (name == "session")
+            return benchSession();
+        if (name == "cache")
+            return benchCache(scriptPath);
+        if (name == "jit")
+            return benchJit();
+        if (name == "host")
+            return benchHostCalls();
+        std::cerr << "Unknown benchmark: " << name << " (expected lexer, values, output, session, cache, jit or host)\n";
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
+    return 1;
+}
\ No newline at end of file
@@ -0,0 +1,3 @@
+#pragma once
+#include <string>
+int runBenchmark(const std::string& name, const std::string& scriptPath);
\ No newline at end of file
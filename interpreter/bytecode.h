@@ -0,0 +1,75 @@
+#pragma once
+#include "symbols.h"
+#include "value.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+// The *_INT forms skip the operand type checks; the compiler emits them
+// where type inference proved both operands are integers.
+#define PDEV_OPCODES(X) \
+    X(PUSH_INT) X(PUSH_CONST) X(PUSH_STRING) X(POP) \
+    X(LOAD_LOCAL) X(STORE_LOCAL) X(LOAD_GLOBAL) X(STORE_GLOBAL) \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(NEG) X(CHECK_INT) \
+    X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+    X(ADD_INT) X(SUB_INT) X(MUL_INT) X(DIV_INT) \
+    X(EQ_INT) X(NE_INT) X(LT_INT) X(LE_INT) X(GT_INT) X(GE_INT) \
+    X(JUMP) X(JUMP_IF_FALSE) X(JUMP_IF_TRUE) \
+    X(INC_LOCAL) X(LOOP_ENTER) X(LOOP_NEXT) X(PARALLEL_FOR) \
+    X(CALL) X(CALL_HOST) X(TAIL_CALL) X(RETURN) X(WRITE) X(FAIL) X(HALT)
+enum class OpCode : uint8_t {
+#define PDEV_OPCODE_ENUM(name) name,
+    PDEV_OPCODES(PDEV_OPCODE_ENUM)
+#undef PDEV_OPCODE_ENUM
+};
+struct Instruction {
+    OpCode op;
+    // Operands of the local-slot instructions (INC_LOCAL, LOOP_ENTER,
+    // LOOP_NEXT, PARALLEL_FOR), kept in what would otherwise be padding.
+    OpCode compare = OpCode::HALT;
+    uint16_t slot = 0;
+    int32_t arg = 0;
+};
+struct CompiledFunction {
+    std::string name;
+    int arity = 0;
+    int frameSize = 0;
+    int maxStack = 0;
+    bool pure = false;
+    std::vector<Instruction> code;
+    std::vector<size_t> positions;
+};
+// A `parallel for`, named by index by its PARALLEL_FOR instruction. The
+// body is a function of its own that runs one iteration in a copy of the
+// enclosing frame and ends in HALT.
+struct ParallelLoop {
+    struct Reduction {
+        OpCode op = OpCode::ADD;  // ADD or MUL
+        bool global = false;
+        int index = 0;
+        size_t position = 0;
+        std::string name;
+    };
+    int body = 0;
+    int32_t step = 0;
+    bool unordered = false;
+    std::vector<Reduction> reductions;
+};
+// A host function named by index by its CALL_HOST instructions (see
+// HostFunctions), looked up by name when the program is run.
+struct HostCall {
+    Symbol name = 0;
+    int arity = 0;
+};
+struct CompiledProgram {
+    // Bodies of parallel loops come last, one per entry of parallelLoops.
+    std::vector<CompiledFunction> functions;
+    // Integer literals too wide for an instruction operand, pushed by
+    // PUSH_CONST; narrower ones are PUSH_INT operands.
+    std::vector<int64_t> constants;
+    std::vector<Value> strings;
+    std::vector<Symbol> globals;
+    std::vector<std::string> messages;
+    std::vector<ParallelLoop> parallelLoops;
+    std::vector<HostCall> hostCalls;
+};
+const char* opcodeName(OpCode op);
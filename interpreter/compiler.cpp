@@ -0,0 +1,450 @@
+#include "compiler.h"
+#include <algorithm>
+#include <limits>
+const char* opcodeName(OpCode op) {
+    static const char* const names[] = {
+#define PDEV_OPCODE_NAME(name) #name,
+        PDEV_OPCODES(PDEV_OPCODE_NAME)
+#undef PDEV_OPCODE_NAME
+    };
+    return names[static_cast<uint8_t>(op)];
+}
+Compiler::Compiler(const Program& program) : program(program) {}
+CompiledProgram Compiler::compile() {
+    result = CompiledProgram();
+    result.functions.resize(program.functions.size() + 1);
+    result.functions[0].name = "<main>";
+    int index = 1;
+    for (const auto& [name, func] : program.functions) {
+        functionIndex[name] = index;
+        result.functions[index].name = SymbolTable::name(name);
+        result.functions[index].arity = static_cast<int>(func->params.size());
+        result.functions[index].pure = func->pure;
+        ++index;
+    }
+    result.globals = program.globals;
+    topLevel = true;
+    compileFunction(result.functions[0], program.statements, program.frameSize);
+    topLevel = false;
+    for (const auto& [name, func] : program.functions)
+        compileFunction(result.functions[functionIndex[name]], func->body, func->frameSize);
+    // Bodies may hold parallel loops of their own, found as they compile.
+    for (size_t i = 0; i < pendingBodies.size(); ++i) {
+        CompiledFunction body;
+        PendingBody pending = pendingBodies[i];
+        compileParallelBody(body, pending);
+        result.functions.push_back(std::move(body));
+    }
+    pendingBodies.clear();
+    return std::move(result);
+}
+void Compiler::compileFunction(CompiledFunction& target, const Block& body, int frameSize) {
+    current = &target;
+    loops.clear();
+    stackDepth = 0;
+    target.frameSize = frameSize;
+    for (const auto& stmt : body)
+        compileStmt(*stmt);
+    if (topLevel) {
+        emit(OpCode::HALT, 0, 0);
+    } else {
+        emit(OpCode::PUSH_INT, 0, 0);
+        emit(OpCode::RETURN, 0, 0);
+    }
+    current = nullptr;
+}
+size_t Compiler::emit(OpCode op, int32_t arg, size_t position) {
+    switch (op) {
+        case OpCode::PUSH_INT: case OpCode::PUSH_CONST: case OpCode::PUSH_STRING:
+        case OpCode::LOAD_LOCAL: case OpCode::LOAD_GLOBAL:
+            ++stackDepth;
+            break;
+        case OpCode::CALL:
+            stackDepth += 1 - result.functions[arg].arity;
+            break;
+        case OpCode::CALL_HOST:
+            stackDepth += 1 - result.hostCalls[arg].arity;
+            break;
+        case OpCode::TAIL_CALL:
+            stackDepth -= result.functions[arg].arity;
+            break;
+        case OpCode::NEG: case OpCode::CHECK_INT: case OpCode::JUMP: case OpCode::FAIL: case OpCode::HALT:
+        case OpCode::INC_LOCAL: case OpCode::LOOP_ENTER: case OpCode::LOOP_NEXT:
+            break;
+        default:
+            --stackDepth;
+            break;
+    }
+    current->maxStack = std::max(current->maxStack, stackDepth);
+    Instruction instruction;
+    instruction.op = op;
+    instruction.arg = arg;
+    current->code.push_back(instruction);
+    current->positions.push_back(position);
+    return current->code.size() - 1;
+}
+void Compiler::emitFail(const std::string& message, size_t position) {
+    result.messages.push_back(message);
+    emit(OpCode::FAIL, static_cast<int32_t>(result.messages.size() - 1), position);
+}
+void Compiler::patch(size_t at, size_t target) {
+    current->code[at].arg = static_cast<int32_t>(target);
+}
+void Compiler::compileBlock(const Block& block) {
+    for (const auto& stmt : block)
+        compileStmt(*stmt);
+}
+void Compiler::compileLoad(const VarRef& ref, size_t position) {
+    emit(ref.kind == VarRef::LOCAL ? OpCode::LOAD_LOCAL : OpCode::LOAD_GLOBAL, ref.index, position);
+}
+void Compiler::compileNumber(int64_t value, size_t position) {
+    if (value >= INT32_MIN && value <= INT32_MAX) {
+        emit(OpCode::PUSH_INT, static_cast<int32_t>(value), position);
+        return;
+    }
+    auto [entry, added] = constantIndex.try_emplace(value, static_cast<int>(result.constants.size()));
+    if (added)
+        result.constants.push_back(value);
+    emit(OpCode::PUSH_CONST, entry->second, position);
+}
+void Compiler::compileStore(const VarRef& ref, size_t position) {
+    emit(ref.kind == VarRef::LOCAL ? OpCode::STORE_LOCAL : OpCode::STORE_GLOBAL, ref.index, position);
+}
+void Compiler::compileLoopBody(const Block& body, Loop& loop) {
+    loops.push_back(std::move(loop));
+    compileBlock(body);
+    loop = std::move(loops.back());
+    loops.pop_back();
+}
+static OpCode binaryOpcode(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::ADD: return OpCode::ADD;
+        case BinaryOp::SUB: return OpCode::SUB;
+        case BinaryOp::MUL: return OpCode::MUL;
+        case BinaryOp::DIV: return OpCode::DIV;
+        case BinaryOp::EQUAL: return OpCode::EQ;
+        case BinaryOp::NOT_EQUAL: return OpCode::NE;
+        case BinaryOp::LESS: return OpCode::LT;
+        case BinaryOp::LESS_EQUAL: return OpCode::LE;
+        case BinaryOp::GREATER: return OpCode::GT;
+        case BinaryOp::GREATER_EQUAL: return OpCode::GE;
+    }
+    return OpCode::ADD;
+}
+// Operands proven to be integers need no type checks.
+static OpCode uncheckedOpcode(OpCode op) {
+    switch (op) {
+        case OpCode::ADD: return OpCode::ADD_INT;
+        case OpCode::SUB: return OpCode::SUB_INT;
+        case OpCode::MUL: return OpCode::MUL_INT;
+        case OpCode::DIV: return OpCode::DIV_INT;
+        case OpCode::EQ: return OpCode::EQ_INT;
+        case OpCode::NE: return OpCode::NE_INT;
+        case OpCode::LT: return OpCode::LT_INT;
+        case OpCode::LE: return OpCode::LE_INT;
+        case OpCode::GT: return OpCode::GT_INT;
+        case OpCode::GE: return OpCode::GE_INT;
+        default: return op;
+    }
+}
+static bool fitsSlot(const VarRef& ref) {
+    return ref.kind == VarRef::LOCAL && ref.index <= std::numeric_limits<uint16_t>::max();
+}
+// The bound is evaluated once and stays on the operand stack for the whole
+// loop; the exit pops it. Each iteration then costs one INC_LOCAL and one
+// LOOP_NEXT instead of the generic load/add/store/compare/branch sequence.
+void Compiler::compileCountedFor(const Stmt& stmt) {
+    if (stmt.init)
+        compileStmt(*stmt.init);
+    const Expr& condition = *stmt.expr;
+    const uint16_t slot = static_cast<uint16_t>(condition.left->ref.index);
+    const OpCode compare = binaryOpcode(condition.op);
+    compileExpr(*condition.right);
+    size_t enter = emit(OpCode::LOOP_ENTER, 0, condition.position);
+    current->code[enter].slot = slot;
+    current->code[enter].compare = compare;
+    size_t body = current->code.size();
+    Loop loop;
+    compileLoopBody(stmt.body, loop);
+    size_t update = emit(OpCode::INC_LOCAL, stmt.step, stmt.update->position);
+    current->code[update].slot = slot;
+    size_t next = emit(OpCode::LOOP_NEXT, static_cast<int32_t>(body), condition.position);
+    current->code[next].slot = slot;
+    current->code[next].compare = compare;
+    size_t exit = current->code.size();
+    patch(enter, exit);
+    emit(OpCode::POP, 0, stmt.position);
+    for (size_t at : loop.breaks) patch(at, exit);
+    for (size_t at : loop.continues) patch(at, update);
+}
+// Everything up to the bound runs here; PARALLEL_FOR pops the bound and runs
+// the iterations on workers (see VM::runParallel). The checks the ast
+// evaluator makes when it reaches the loop become FAILs in its place.
+void Compiler::compileParallelFor(const Stmt& stmt) {
+    const Parallel& parallel = *stmt.parallel;
+    if (parallel.sharedStore) {
+        emitFail("Cannot assign outer variable inside parallel for: " + SymbolTable::name(parallel.sharedStore->name), parallel.sharedStore->position);
+        return;
+    }
+    if (stmt.step == 0 || !fitsSlot(stmt.expr->left->ref)) {
+        emitFail("parallel for needs a counted loop", stmt.position);
+        return;
+    }
+    if (stmt.init)
+        compileStmt(*stmt.init);
+    const Expr& condition = *stmt.expr;
+    compileExpr(*condition.right);
+    ParallelLoop loop;
+    loop.body = static_cast<int>(program.functions.size() + 1 + result.parallelLoops.size());
+    loop.step = stmt.step;
+    loop.unordered = parallel.unordered;
+    for (const auto& reduction : parallel.reductions) {
+        ParallelLoop::Reduction entry;
+        entry.op = reduction.op == BinaryOp::MUL ? OpCode::MUL : OpCode::ADD;
+        entry.global = reduction.ref.kind == VarRef::GLOBAL;
+        entry.index = reduction.ref.index;
+        entry.position = reduction.position;
+        entry.name = SymbolTable::name(reduction.name);
+        loop.reductions.push_back(std::move(entry));
+    }
+    size_t at = emit(OpCode::PARALLEL_FOR, static_cast<int32_t>(result.parallelLoops.size()), condition.position);
+    current->code[at].slot = static_cast<uint16_t>(condition.left->ref.index);
+    current->code[at].compare = binaryOpcode(condition.op);
+    result.parallelLoops.push_back(std::move(loop));
+    pendingBodies.push_back({&stmt, current->name, current->frameSize});
+}
+// One iteration: continue ends it early, while break and return would
+// leave the loop from a single worker and fail instead.
+void Compiler::compileParallelBody(CompiledFunction& target, const PendingBody& pending) {
+    const Stmt& stmt = *pending.loop;
+    current = &target;
+    loops.clear();
+    stackDepth = 0;
+    target.name = pending.name;
+    target.frameSize = pending.frameSize;
+    parallelBody = &stmt;
+    Loop loop;
+    compileLoopBody(stmt.body, loop);
+    size_t end = emit(OpCode::HALT, 0, stmt.position);
+    for (size_t at : loop.continues) patch(at, end);
+    if (!loop.breaks.empty()) {
+        for (size_t at : loop.breaks) patch(at, current->code.size());
+        emitFail("'break' cannot leave a parallel for", stmt.position);
+    }
+    parallelBody = nullptr;
+    current = nullptr;
+}
+// Calls that would fail at run time go through the regular path so they
+// report the same error.
+bool Compiler::compileTailCall(const Expr& call) {
+    auto found = functionIndex.find(call.symbol);
+    if (found == functionIndex.end() || static_cast<int>(call.args.size()) != result.functions[found->second].arity)
+        return false;
+    for (const auto& arg : call.args)
+        compileExpr(*arg);
+    emit(OpCode::TAIL_CALL, found->second, call.position);
+    return true;
+}
+void Compiler::compileStmt(const Stmt& stmt) {
+    switch (stmt.kind) {
+        case Stmt::ASSIGN:
+            compileExpr(*stmt.expr);
+            compileStore(stmt.ref, stmt.position);
+            break;
+        case Stmt::INCREMENT:
+        case Stmt::DECREMENT:
+            if (fitsSlot(stmt.ref)) {
+                size_t at = emit(OpCode::INC_LOCAL, stmt.kind == Stmt::INCREMENT ? 1 : -1, stmt.position);
+                current->code[at].slot = static_cast<uint16_t>(stmt.ref.index);
+                break;
+            }
+            compileLoad(stmt.ref, stmt.position);
+            emit(OpCode::PUSH_INT, 1, stmt.position);
+            emit(stmt.kind == Stmt::INCREMENT ? OpCode::ADD : OpCode::SUB, 0, stmt.position);
+            compileStore(stmt.ref, stmt.position);
+            break;
+        case Stmt::CALL:
+            compileExpr(*stmt.expr);
+            emit(OpCode::POP, 0, stmt.position);
+            break;
+        case Stmt::WRITE:
+            compileExpr(*stmt.expr);
+            emit(OpCode::WRITE, 0, stmt.position);
+            break;
+        case Stmt::IF: {
+            compileExpr(*stmt.expr);
+            size_t skipThen = emit(OpCode::JUMP_IF_FALSE, 0, stmt.position);
+            compileBlock(stmt.body);
+            if (stmt.elseBody.empty()) {
+                patch(skipThen, current->code.size());
+                break;
+            }
+            size_t skipElse = emit(OpCode::JUMP, 0, stmt.position);
+            patch(skipThen, current->code.size());
+            compileBlock(stmt.elseBody);
+            patch(skipElse, current->code.size());
+            break;
+        }
+        case Stmt::WHILE: {
+            size_t start = current->code.size();
+            compileExpr(*stmt.expr);
+            size_t exit = emit(OpCode::JUMP_IF_FALSE, 0, stmt.position);
+            Loop loop;
+            compileLoopBody(stmt.body, loop);
+            emit(OpCode::JUMP, static_cast<int32_t>(start), stmt.position);
+            patch(exit, current->code.size());
+            for (size_t at : loop.breaks) patch(at, current->code.size());
+            for (size_t at : loop.continues) patch(at, start);
+            break;
+        }
+        case Stmt::DO_WHILE: {
+            size_t start = current->code.size();
+            Loop loop;
+            compileLoopBody(stmt.body, loop);
+            size_t condition = current->code.size();
+            compileExpr(*stmt.expr);
+            emit(OpCode::JUMP_IF_TRUE, static_cast<int32_t>(start), stmt.position);
+            for (size_t at : loop.breaks) patch(at, current->code.size());
+            for (size_t at : loop.continues) patch(at, condition);
+            break;
+        }
+        case Stmt::FOR: {
+            if (stmt.parallel) {
+                compileParallelFor(stmt);
+                break;
+            }
+            if (stmt.step != 0 && fitsSlot(stmt.expr->left->ref)) {
+                compileCountedFor(stmt);
+                break;
+            }
+            if (stmt.init)
+                compileStmt(*stmt.init);
+            size_t start = current->code.size();
+            size_t exit = 0;
+            if (stmt.expr) {
+                compileExpr(*stmt.expr);
+                exit = emit(OpCode::JUMP_IF_FALSE, 0, stmt.position);
+            }
+            Loop loop;
+            compileLoopBody(stmt.body, loop);
+            size_t update = current->code.size();
+            if (stmt.update)
+                compileStmt(*stmt.update);
+            emit(OpCode::JUMP, static_cast<int32_t>(start), stmt.position);
+            if (stmt.expr)
+                patch(exit, current->code.size());
+            for (size_t at : loop.breaks) patch(at, current->code.size());
+            for (size_t at : loop.continues) patch(at, update);
+            break;
+        }
+        case Stmt::BREAK:
+        case Stmt::CONTINUE:
+            if (loops.empty()) {
+                emitFail("'break' or 'continue' outside of a loop", stmt.position);
+                break;
+            }
+            if (stmt.kind == Stmt::BREAK)
+                loops.back().breaks.push_back(emit(OpCode::JUMP, 0, stmt.position));
+            else
+                loops.back().continues.push_back(emit(OpCode::JUMP, 0, stmt.position));
+            break;
+        case Stmt::PASS:
+            break;
+        case Stmt::RETURN:
+            if (parallelBody) {
+                if (stmt.expr) {
+                    compileExpr(*stmt.expr);
+                    emit(OpCode::POP, 0, stmt.position);
+                }
+                emitFail("'return' cannot leave a parallel for", parallelBody->position);
+                break;
+            }
+            if (stmt.tailCall && !topLevel && compileTailCall(*stmt.expr))
+                break;
+            if (stmt.expr)
+                compileExpr(*stmt.expr);
+            else
+                emit(OpCode::PUSH_INT, 0, stmt.position);
+            if (topLevel) {
+                emit(OpCode::POP, 0, stmt.position);
+                emit(OpCode::HALT, 0, stmt.position);
+            } else {
+                emit(OpCode::RETURN, 0, stmt.position);
+            }
+            break;
+        case Stmt::BLOCK:
+            compileBlock(stmt.body);
+            break;
+    }
+}
+// Host functions are numbered per program, since the names registered in
+// the process that runs it may differ.
+void Compiler::compileHostCall(const Expr& call) {
+    const HostFunctions::Entry& host = *HostFunctions::find(call.symbol);
+    if (call.args.size() != host.arity) {
+        emitFail("Function " + SymbolTable::name(call.symbol) + " expects " + std::to_string(host.arity) + " arguments, but got " + std::to_string(call.args.size()), call.position);
+        emit(OpCode::PUSH_INT, 0, call.position);
+        return;
+    }
+    auto [entry, added] = hostIndex.try_emplace(call.symbol, static_cast<int>(result.hostCalls.size()));
+    if (added)
+        result.hostCalls.push_back({call.symbol, static_cast<int>(host.arity)});
+    for (const auto& arg : call.args)
+        compileExpr(*arg);
+    emit(OpCode::CALL_HOST, entry->second, call.position);
+}
+void Compiler::compileExpr(const Expr& expr) {
+    switch (expr.kind) {
+        case Expr::NUMBER:
+            compileNumber(expr.number, expr.position);
+            return;
+        case Expr::STRING: {
+            // Literals are interned, so each distinct one gets a single entry.
+            auto [entry, added] = stringIndex.try_emplace(expr.symbol, static_cast<int>(result.strings.size()));
+            if (added)
+                result.strings.push_back(SymbolTable::string(expr.symbol));
+            emit(OpCode::PUSH_STRING, entry->second, expr.position);
+            return;
+        }
+        case Expr::VARIABLE:
+            compileLoad(expr.ref, expr.position);
+            return;
+        case Expr::NEGATE:
+            compileExpr(*expr.left);
+            emit(OpCode::NEG, 0, expr.position);
+            return;
+        case Expr::CHECK_INT:
+            compileExpr(*expr.left);
+            if (!expr.left->isInt)
+                emit(OpCode::CHECK_INT, 0, expr.position);
+            return;
+        case Expr::CALL: {
+            auto found = functionIndex.find(expr.symbol);
+            if (found == functionIndex.end() && HostFunctions::find(expr.symbol)) {
+                compileHostCall(expr);
+                return;
+            }
+            if (found == functionIndex.end()) {
+                emitFail("Undefined function: " + SymbolTable::name(expr.symbol), expr.position);
+                emit(OpCode::PUSH_INT, 0, expr.position);
+                return;
+            }
+            const CompiledFunction& callee = result.functions[found->second];
+            if (static_cast<int>(expr.args.size()) != callee.arity) {
+                emitFail("Function " + callee.name + " expects " + std::to_string(callee.arity) + " arguments, but got " + std::to_string(expr.args.size()), expr.position);
+                emit(OpCode::PUSH_INT, 0, expr.position);
+                return;
+            }
+            for (const auto& arg : expr.args)
+                compileExpr(*arg);
+            emit(OpCode::CALL, found->second, expr.position);
+            return;
+        }
+        case Expr::BINARY:
+            break;
+    }
+    compileExpr(*expr.left);
+    compileExpr(*expr.right);
+    OpCode op = binaryOpcode(expr.op);
+    emit(expr.left->isInt && expr.right->isInt ? uncheckedOpcode(op) : op, 0, expr.position);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "ast.h"
+#include "bytecode.h"
+#include "hostfunctions.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+class Compiler {
+public:
+    Compiler(const Program& program);
+    CompiledProgram compile();
+private:
+    struct Loop {
+        std::vector<size_t> breaks;
+        std::vector<size_t> continues;
+    };
+    // A parallel loop whose body is compiled once the functions are done.
+    struct PendingBody {
+        const Stmt* loop;
+        std::string name;
+        int frameSize;
+    };
+    const Program& program;
+    CompiledProgram result;
+    CompiledFunction* current = nullptr;
+    bool topLevel = true;
+    int stackDepth = 0;
+    std::vector<Loop> loops;
+    std::unordered_map<Symbol, int> functionIndex;
+    std::unordered_map<Symbol, int> hostIndex;
+    std::unordered_map<int64_t, int> constantIndex;
+    std::unordered_map<Symbol, int> stringIndex;
+    std::vector<PendingBody> pendingBodies;
+    // The loop whose body is being compiled, where break and return fail.
+    const Stmt* parallelBody = nullptr;
+    void compileFunction(CompiledFunction& target, const Block& body, int frameSize);
+    void compileBlock(const Block& block);
+    void compileStmt(const Stmt& stmt);
+    void compileExpr(const Expr& expr);
+    void compileLoopBody(const Block& body, Loop& loop);
+    void compileCountedFor(const Stmt& stmt);
+    void compileParallelFor(const Stmt& stmt);
+    void compileParallelBody(CompiledFunction& target, const PendingBody& pending);
+    bool compileTailCall(const Expr& call);
+    void compileHostCall(const Expr& call);
+    void compileStore(const VarRef& ref, size_t position);
+    void compileLoad(const VarRef& ref, size_t position);
+    void compileNumber(int64_t value, size_t position);
+    size_t emit(OpCode op, int32_t arg, size_t position);
+    void emitFail(const std::string& message, size_t position);
+    void patch(size_t at, size_t target);
+};
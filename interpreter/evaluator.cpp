@@ -0,0 +1,668 @@
+#include "evaluator.h"
+#include "ErrorHandler.h"
+#include "arithmetic.h"
+#include "compiler.h"
+#include "parallel.h"
+#include "tiering.h"
+#include <algorithm>
+#include <cstdint>
+#ifdef __linux__
+#include <pthread.h>
+#endif
+// Script calls recurse on the native stack. Below the deepest call the
+// jit may still need 2 MiB for native frames (see Jit::run), plus some
+// room for host functions and error handling; small stacks keep a quarter.
+static constexpr uintptr_t stackReserve = (2u << 20) + (512u << 10);
+// Where the thread's stack bounds are unknown, a typical 8 MiB stack is
+// assumed to start at the outermost evaluation.
+static constexpr uintptr_t assumedStack = 8u << 20;
+static thread_local uintptr_t stackLimit = 0;
+static uintptr_t stackLimitBelow(uintptr_t here) {
+    static thread_local uintptr_t threadLimit = 0;
+#ifdef __linux__
+    if (!threadLimit) {
+        pthread_attr_t attr;
+        if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+            void* low;
+            size_t size;
+            if (pthread_attr_getstack(&attr, &low, &size) == 0)
+                threadLimit = reinterpret_cast<uintptr_t>(low) + std::min<uintptr_t>(stackReserve, size / 4);
+            pthread_attr_destroy(&attr);
+        }
+    }
+#endif
+    if (threadLimit && threadLimit < here)
+        return threadLimit;
+    return here - (assumedStack - stackReserve);
+}
+namespace {
+// Sets the limit for the outermost evaluation on this thread; nested ones,
+// such as a parallel chunk run by the thread that started the loop, keep it.
+class StackGuard {
+public:
+    StackGuard() : outermost(stackLimit == 0) {
+        if (outermost)
+            stackLimit = stackLimitBelow(reinterpret_cast<uintptr_t>(this));
+    }
+    ~StackGuard() {
+        if (outermost)
+            stackLimit = 0;
+    }
+    StackGuard(const StackGuard&) = delete;
+    StackGuard& operator=(const StackGuard&) = delete;
+private:
+    bool outermost;
+};
+}
+Evaluator::Evaluator(const Program& program, const Lexer& lexer, OutputChannel& output)
+    : Evaluator(program, lexer.getSourceMap(), output) {}
+Evaluator::Evaluator(const Program& program, const SourceMap& sourceMap, OutputChannel& output)
+    : program(program), sourceMap(&sourceMap), output(output), stack(program.frameSize), globals(program.globals.size()), globalDefined(program.globals.size(), false) {}
+// Workers start from isolated copies of the frame and globals of the
+// evaluator running the loop, which waits for them meanwhile.
+Evaluator::Evaluator(const Evaluator& parent, const Stmt& loop, OutputChannel& output)
+    : program(parent.program), sourceMap(parent.sourceMap), output(output), globalDefined(parent.globalDefined) {
+    worker = true;
+    stack.reserve(parent.stack.size() - parent.frameBase);
+    for (size_t i = parent.frameBase; i < parent.stack.size(); ++i)
+        stack.push_back(parent.stack[i].isolated());
+    globals.reserve(parent.globals.size());
+    for (const Value& value : parent.globals)
+        globals.push_back(value.isolated());
+    readOnlyGlobals.assign(globals.size(), true);
+    for (const auto& reduction : loop.parallel->reductions) {
+        if (reduction.ref.kind == VarRef::GLOBAL)
+            readOnlyGlobals[reduction.ref.index] = false;
+    }
+    for (const auto& [func, entry] : parent.profiles) {
+        if (&entry == parent.currentProfile)
+            currentProfile = &profile(*func);
+    }
+}
+Evaluator::~Evaluator() {
+    flushProfiles();
+}
+void Evaluator::error(const std::string& message, size_t position) const {
+    ErrorHandler::throwError(message, sourceMap->locate(position));
+}
+void Evaluator::setSourceMap(const SourceMap& map) {
+    sourceMap = &map;
+}
+const Value* Evaluator::global(int index) const {
+    if (index >= static_cast<int>(globalDefined.size()) || !globalDefined[index])
+        return nullptr;
+    return &globals[index];
+}
+void Evaluator::run() {
+    execute(program.statements);
+}
+// Runs top-level statements. The program may have gained globals, top-level
+// slots or functions since the previous call, and a previous call may have
+// been abandoned by an error partway through a function.
+void Evaluator::execute(const Block& statements) {
+    StackGuard guard;
+    frameBase = 0;
+    tailCallee = nullptr;
+    currentProfile = nullptr;
+    flushLoopProfiles();
+    stack.resize(program.frameSize);
+    globals.resize(program.globals.size());
+    globalDefined.resize(program.globals.size(), false);
+    for (const auto& stmt : statements) {
+        Flow flow = exec(*stmt);
+        if (flow == Flow::RETURN)
+            return;
+        if (flow != Flow::NORMAL)
+            error("'break' or 'continue' outside of a loop", stmt->position);
+    }
+}
+Value& Evaluator::load(const VarRef& ref, Symbol name, size_t position) {
+    if (ref.kind == VarRef::LOCAL)
+        return stack[frameBase + ref.index];
+    if (!globalDefined[ref.index])
+        error("Undefined variable: " + SymbolTable::name(name), position);
+    return globals[ref.index];
+}
+void Evaluator::store(const VarRef& ref, Value value) {
+    if (ref.kind == VarRef::LOCAL) {
+        stack[frameBase + ref.index] = std::move(value);
+        return;
+    }
+    globals[ref.index] = std::move(value);
+    globalDefined[ref.index] = true;
+}
+void Evaluator::checkWritable(const Stmt& stmt) const {
+    if (stmt.ref.kind == VarRef::GLOBAL && !readOnlyGlobals.empty() && readOnlyGlobals[stmt.ref.index])
+        error("Cannot assign global variable inside parallel for: " + SymbolTable::name(stmt.name), stmt.position);
+}
+Evaluator::Flow Evaluator::execBody(const Block& block) {
+    for (const auto& stmt : block) {
+        Flow flow = exec(*stmt);
+        if (flow != Flow::NORMAL)
+            return flow;
+    }
+    return Flow::NORMAL;
+}
+Evaluator::Flow Evaluator::exec(const Stmt& stmt) {
+    switch (stmt.kind) {
+        case Stmt::ASSIGN: {
+            Value value = eval(*stmt.expr);
+            if (worker)
+                checkWritable(stmt);
+            store(stmt.ref, std::move(value));
+            return Flow::NORMAL;
+        }
+        case Stmt::INCREMENT:
+        case Stmt::DECREMENT: {
+            Value* var = &load(stmt.ref, stmt.name, stmt.position);
+            if (!var->isInt())
+                error("Cannot " + std::string(stmt.kind == Stmt::INCREMENT ? "increment" : "decrement") + " non-integer variable: " + SymbolTable::name(stmt.name), stmt.position);
+            int64_t result;
+            bool exact = Arithmetic::add(var->asInt(), stmt.kind == Stmt::INCREMENT ? 1 : -1, result);
+            result = arithmetic(exact, result, stmt.position);
+            if (worker)
+                checkWritable(stmt);
+            *var = result;
+            return Flow::NORMAL;
+        }
+        case Stmt::CALL:
+            eval(*stmt.expr);
+            return Flow::NORMAL;
+        case Stmt::WRITE:
+            output.writeLine(eval(*stmt.expr));
+            return Flow::NORMAL;
+        case Stmt::IF:
+            if (evalCondition(*stmt.expr))
+                return execBody(stmt.body);
+            return stmt.elseBody.empty() ? Flow::NORMAL : execBody(stmt.elseBody);
+        case Stmt::WHILE: {
+            Flow result = Flow::NORMAL;
+            uint64_t iterations = 0;
+            while (evalCondition(*stmt.expr)) {
+                ++iterations;
+                Flow flow = execBody(stmt.body);
+                if (flow == Flow::BREAK)
+                    break;
+                if (flow == Flow::RETURN) {
+                    result = flow;
+                    break;
+                }
+            }
+            countLoop(stmt, iterations);
+            return result;
+        }
+        case Stmt::DO_WHILE: {
+            Flow result = Flow::NORMAL;
+            uint64_t iterations = 0;
+            do {
+                ++iterations;
+                Flow flow = execBody(stmt.body);
+                if (flow == Flow::BREAK)
+                    break;
+                if (flow == Flow::RETURN) {
+                    result = flow;
+                    break;
+                }
+            } while (evalCondition(*stmt.expr));
+            countLoop(stmt, iterations);
+            return result;
+        }
+        case Stmt::FOR:
+            return stmt.parallel ? execParallelFor(stmt) : execFor(stmt);
+        case Stmt::BREAK:
+            return Flow::BREAK;
+        case Stmt::CONTINUE:
+            return Flow::CONTINUE;
+        case Stmt::PASS:
+            return Flow::NORMAL;
+        case Stmt::RETURN:
+            if (stmt.tailCall) {
+                prepareTailCall(*stmt.expr);
+                return Flow::RETURN;
+            }
+            returnValue = stmt.expr ? eval(*stmt.expr) : Value();
+            return Flow::RETURN;
+        case Stmt::BLOCK:
+            return execBody(stmt.body);
+    }
+    return Flow::NORMAL;
+}
+Evaluator::Flow Evaluator::execFor(const Stmt& stmt) {
+    Flow result = Flow::NORMAL;
+    if (stmt.init)
+        exec(*stmt.init);
+    if (stmt.step != 0) {
+        Value bound = eval(*stmt.expr->right);
+        if (bound.isInt() && stack[frameBase + stmt.expr->left->ref.index].isInt())
+            return execCountedFor(stmt, bound.asInt());
+    }
+    uint64_t iterations = 0;
+    while (!stmt.expr || evalCondition(*stmt.expr)) {
+        ++iterations;
+        Flow flow = execBody(stmt.body);
+        if (flow == Flow::BREAK)
+            break;
+        if (flow == Flow::RETURN) {
+            result = flow;
+            break;
+        }
+        if (stmt.update)
+            exec(*stmt.update);
+    }
+    countLoop(stmt, iterations);
+    return result;
+}
+static bool compareInts(BinaryOp op, int64_t lhs, int64_t rhs) {
+    switch (op) {
+        case BinaryOp::LESS: return lhs < rhs;
+        case BinaryOp::LESS_EQUAL: return lhs <= rhs;
+        case BinaryOp::GREATER: return lhs > rhs;
+        case BinaryOp::GREATER_EQUAL: return lhs >= rhs;
+        case BinaryOp::NOT_EQUAL: return lhs != rhs;
+        default: return false;
+    }
+}
+// The resolver guarantees the body never stores the induction variable and
+// never changes the bound, so the counter lives here and the slot is only
+// written for the body to read.
+Evaluator::Flow Evaluator::execCountedFor(const Stmt& stmt, int64_t bound) {
+    const size_t slot = stmt.expr->left->ref.index;
+    const BinaryOp op = stmt.expr->op;
+    int64_t counter = stack[frameBase + slot].asInt();
+    Flow result = Flow::NORMAL;
+    uint64_t iterations = 0;
+    while (compareInts(op, counter, bound)) {
+        ++iterations;
+        Flow flow = execBody(stmt.body);
+        if (flow == Flow::BREAK)
+            break;
+        if (flow == Flow::RETURN) {
+            result = flow;
+            break;
+        }
+        bool exact = Arithmetic::add(counter, stmt.step, counter);
+        stack[frameBase + slot] = arithmetic(exact, counter, stmt.update->position);
+    }
+    countLoop(stmt, iterations);
+    return result;
+}
+static ParallelFor::Until parallelUntil(BinaryOp op) {
+    switch (op) {
+        case BinaryOp::LESS_EQUAL: return ParallelFor::Until::LESS_EQUAL;
+        case BinaryOp::GREATER: return ParallelFor::Until::GREATER;
+        case BinaryOp::GREATER_EQUAL: return ParallelFor::Until::GREATER_EQUAL;
+        case BinaryOp::NOT_EQUAL: return ParallelFor::Until::NOT_EQUAL;
+        default: return ParallelFor::Until::LESS;
+    }
+}
+static ParallelFor::Reduce parallelReduce(BinaryOp op) {
+    return op == BinaryOp::MUL ? ParallelFor::Reduce::MULTIPLY : ParallelFor::Reduce::ADD;
+}
+// The initializer and the bound run here; the iterations run on workers,
+// each over its own copy of the frame and globals, with the reductions
+// combined back into this frame afterwards. Only counted loops qualify, so
+// the iteration count is known up front.
+Evaluator::Flow Evaluator::execParallelFor(const Stmt& stmt) {
+    const Parallel& parallel = *stmt.parallel;
+    if (parallel.sharedStore)
+        error("Cannot assign outer variable inside parallel for: " + SymbolTable::name(parallel.sharedStore->name), parallel.sharedStore->position);
+    if (stmt.step == 0)
+        error("parallel for needs a counted loop", stmt.position);
+    if (stmt.init)
+        exec(*stmt.init);
+    const Expr& condition = *stmt.expr;
+    Value bound = eval(*condition.right);
+    const Value& counter = stack[frameBase + condition.left->ref.index];
+    if (!counter.isInt() || !bound.isInt())
+        error("Expected an integer value", condition.position);
+    const int64_t start = counter.asInt();
+    uint64_t count;
+    if (!ParallelFor::iterations(parallelUntil(condition.op), start, bound.asInt(), stmt.step, count))
+        error("parallel for never reaches its bound", condition.position);
+    std::vector<ParallelFor::Reduce> ops;
+    for (const auto& reduction : parallel.reductions) {
+        if (!load(reduction.ref, reduction.name, reduction.position).isInt())
+            error("Reduction variable is not an integer: " + SymbolTable::name(reduction.name), reduction.position);
+        ops.push_back(parallelReduce(reduction.op));
+    }
+    ParallelFor loop(output, parallel.unordered, ops);
+    std::vector<std::unique_ptr<Evaluator>> workers(loop.workers());
+    try {
+        loop.run(start, stmt.step, count, [&](size_t index, int64_t first, uint64_t length, int64_t* partials) {
+            std::unique_ptr<Evaluator>& engine = workers[index];
+            if (!engine)
+                engine.reset(new Evaluator(*this, stmt, loop.output(index)));
+            try {
+                engine->runChunk(stmt, first, length, partials);
+            } catch (...) {
+                // An error leaves the worker partway through a call; an
+                // earlier chunk it may still take gets a fresh one.
+                engine.reset();
+                throw;
+            }
+        });
+    } catch (...) {
+        absorb(workers);
+        throw;
+    }
+    absorb(workers);
+    for (size_t r = 0; r < parallel.reductions.size(); ++r) {
+        const auto& reduction = parallel.reductions[r];
+        Value& var = load(reduction.ref, reduction.name, reduction.position);
+        int64_t result;
+        bool exact = ParallelFor::combine(ops[r], var.asInt(), loop.results()[r], result) && loop.exact(r);
+        var = arithmetic(exact, result, reduction.position);
+    }
+    countLoop(stmt, count);
+    return Flow::NORMAL;
+}
+void Evaluator::runChunk(const Stmt& loop, int64_t first, uint64_t count, int64_t* partials) {
+    StackGuard guard;
+    const auto& reductions = loop.parallel->reductions;
+    for (const auto& reduction : reductions)
+        store(reduction.ref, ParallelFor::identity(parallelReduce(reduction.op)));
+    const size_t slot = frameBase + loop.expr->left->ref.index;
+    uint64_t counter = static_cast<uint64_t>(first);
+    for (uint64_t i = 0; i < count; ++i, counter += static_cast<uint64_t>(static_cast<int64_t>(loop.step))) {
+        stack[slot] = static_cast<int64_t>(counter);
+        Flow flow = execBody(loop.body);
+        if (flow == Flow::BREAK || flow == Flow::RETURN)
+            error(std::string(flow == Flow::BREAK ? "'break'" : "'return'") + " cannot leave a parallel for", loop.position);
+    }
+    for (size_t r = 0; r < reductions.size(); ++r) {
+        const Value& var = load(reductions[r].ref, reductions[r].name, reductions[r].position);
+        if (!var.isInt())
+            error("Reduction variable is not an integer: " + SymbolTable::name(reductions[r].name), reductions[r].position);
+        partials[r] = var.asInt();
+    }
+}
+// Hotness gathered by workers counts towards tier-up here.
+void Evaluator::absorb(std::vector<std::unique_ptr<Evaluator>>& workers) {
+    for (auto& engine : workers) {
+        if (!engine)
+            continue;
+        for (const auto& [func, entry] : engine->profiles) {
+            Profile& mine = profile(*func);
+            mine.calls += entry.calls;
+            mine.iterations += entry.iterations;
+        }
+        engine->profiles.clear();
+        for (const auto& [loop, entry] : engine->loopProfiles) {
+            auto [mine, added] = loopProfiles.try_emplace(loop, entry);
+            if (!added)
+                mine->second.iterations += entry.iterations;
+        }
+        engine->loopProfiles.clear();
+    }
+}
+bool Evaluator::evalCondition(const Expr& expr) {
+    return evalInt(expr) != 0;
+}
+// Wrapped results pass through unless overflow trapping is on.
+int64_t Evaluator::arithmetic(bool exact, int64_t result, size_t position) const {
+    if (!exact && Arithmetic::trapOverflow())
+        error("Integer overflow", position);
+    return result;
+}
+// Reads proven to be integers (see Resolver::inferTypes) skip the check.
+int64_t Evaluator::evalInt(const Expr& expr) {
+    if (expr.isInt && expr.kind == Expr::VARIABLE && expr.ref.kind == VarRef::LOCAL)
+        return stack[frameBase + expr.ref.index].asInt();
+    Value val = eval(expr);
+    if (!expr.isInt && !val.isInt()) {
+        if (expr.kind == Expr::VARIABLE)
+            error("Variable is not an integer: " + SymbolTable::name(expr.symbol), expr.position);
+        error("Expected an integer value", expr.position);
+    }
+    return val.asInt();
+}
+Value Evaluator::eval(const Expr& expr) {
+    switch (expr.kind) {
+        case Expr::NUMBER:
+            return expr.number;
+        case Expr::STRING:
+            return SymbolTable::string(expr.symbol);
+        case Expr::VARIABLE:
+            return load(expr.ref, expr.symbol, expr.position);
+        case Expr::NEGATE: {
+            int64_t result;
+            bool exact = Arithmetic::negate(evalInt(*expr.left), result);
+            return arithmetic(exact, result, expr.position);
+        }
+        case Expr::CHECK_INT:
+            return evalInt(*expr.left);
+        case Expr::CALL:
+            return call(expr);
+        case Expr::BINARY:
+            break;
+    }
+    if ((expr.op == BinaryOp::EQUAL || expr.op == BinaryOp::NOT_EQUAL) && !(expr.left->isInt && expr.right->isInt)) {
+        bool equal = eval(*expr.left) == eval(*expr.right);
+        return (expr.op == BinaryOp::EQUAL) == equal ? 1 : 0;
+    }
+    int64_t lhs = evalInt(*expr.left);
+    int64_t rhs = evalInt(*expr.right);
+    int64_t result = 0;
+    bool exact = true;
+    switch (expr.op) {
+        case BinaryOp::ADD: exact = Arithmetic::add(lhs, rhs, result); break;
+        case BinaryOp::SUB: exact = Arithmetic::subtract(lhs, rhs, result); break;
+        case BinaryOp::MUL: exact = Arithmetic::multiply(lhs, rhs, result); break;
+        case BinaryOp::DIV:
+            if (rhs == 0)
+                error("Division by zero", expr.position);
+            exact = Arithmetic::divide(lhs, rhs, result);
+            break;
+        case BinaryOp::EQUAL: return lhs == rhs ? 1 : 0;
+        case BinaryOp::NOT_EQUAL: return lhs != rhs ? 1 : 0;
+        case BinaryOp::LESS: return lhs < rhs ? 1 : 0;
+        case BinaryOp::LESS_EQUAL: return lhs <= rhs ? 1 : 0;
+        case BinaryOp::GREATER: return lhs > rhs ? 1 : 0;
+        case BinaryOp::GREATER_EQUAL: return lhs >= rhs ? 1 : 0;
+    }
+    return arithmetic(exact, result, expr.position);
+}
+// Null when the call goes to a host function, which is left in `host`.
+const FunctionDef* Evaluator::callee(const Expr& expr, const HostFunctions::Entry*& host) {
+    const FunctionDef* cached = expr.callee;
+    host = expr.host;
+    if (expr.calleeVersion != program.functionVersion) {
+        auto found = program.functions.find(expr.symbol);
+        cached = found != program.functions.end() ? found->second.get() : nullptr;
+        host = cached ? nullptr : HostFunctions::find(expr.symbol);
+        if (!cached && !host)
+            error("Undefined function: " + SymbolTable::name(expr.symbol), expr.position);
+        // Workers share the ast, so they only read the cache.
+        if (!worker) {
+            expr.callee = cached;
+            expr.host = host;
+            expr.calleeVersion = program.functionVersion;
+        }
+    }
+    size_t arity = cached ? cached->params.size() : host->arity;
+    if (expr.args.size() != arity)
+        error("Function " + SymbolTable::name(expr.symbol) + " expects " + std::to_string(arity) + " arguments, but got " + std::to_string(expr.args.size()), expr.position);
+    return cached;
+}
+// The arguments stay on the stack for the call, which reads them in place.
+Value Evaluator::callHost(const Expr& expr, const HostFunctions::Entry& host) {
+    size_t base = stack.size();
+    for (const auto& arg : expr.args) {
+        Value value = eval(*arg);
+        stack.push_back(std::move(value));
+    }
+    Value result;
+    try {
+        result = host.function(HostFunctions::Arguments(stack.data() + base, host.arity));
+    } catch (const std::exception& e) {
+        stack.resize(base);
+        error(e.what(), expr.position);
+    }
+    stack.resize(base);
+    return result;
+}
+// Arguments are evaluated above the current frame, since they may read its
+// locals, then moved down over it; call() runs the callee in the same frame.
+void Evaluator::prepareTailCall(const Expr& expr) {
+    const HostFunctions::Entry* host;
+    const FunctionDef* func = callee(expr, host);
+    if (!func) {
+        returnValue = callHost(expr, *host);
+        return;
+    }
+    size_t top = stack.size();
+    for (const auto& arg : expr.args) {
+        Value value = eval(*arg);
+        stack.push_back(std::move(value));
+    }
+    std::move(stack.begin() + top, stack.end(), stack.begin() + frameBase);
+    stack.resize(frameBase + func->params.size());
+    stack.resize(frameBase + func->frameSize);
+    tailCallee = func;
+}
+// Redefining any function can change what a pure caller returns, so every
+// table is dropped when the program's functions change.
+MemoTable& Evaluator::memoTable(const FunctionDef& func) {
+    if (memoVersion != program.functionVersion) {
+        memoTables.clear();
+        memoVersion = program.functionVersion;
+    }
+    auto& table = memoTables[&func];
+    if (!table)
+        table = std::make_unique<MemoTable>(SymbolTable::name(func.name));
+    return *table;
+}
+Value Evaluator::call(const Expr& expr) {
+    const HostFunctions::Entry* host;
+    const FunctionDef* func = callee(expr, host);
+    if (!func)
+        return callHost(expr, *host);
+    char marker;
+    if (reinterpret_cast<uintptr_t>(&marker) < stackLimit)
+        error("Recursion too deep in function " + SymbolTable::name(func->name), expr.position);
+    size_t base = stack.size();
+    for (const auto& arg : expr.args) {
+        Value value = eval(*arg);
+        stack.push_back(std::move(value));
+    }
+    Profile* calleeProfile = &profile(*func);
+    ++calleeProfile->calls;
+    if (calleeProfile->tier.empty() && !worker && Tiering::enabled() && calleeProfile->calls + calleeProfile->iterations >= Tiering::threshold())
+        tierUp(*func, *calleeProfile);
+    MemoTable* memo = nullptr;
+    MemoKey key;
+    if (func->pure && MemoTable::eligible(func->params.size())) {
+        memo = &memoTable(*func);
+        key = MemoKey(stack.data() + base, func->params.size());
+        if (const Value* hit = memo->find(key)) {
+            Value result = *hit;
+            stack.resize(base);
+            return result;
+        }
+    }
+    int64_t nativeResult;
+    if (calleeProfile->native >= 0 && nativeTier->jit->call(calleeProfile->native, stack.data() + base, nativeResult)) {
+        stack.resize(base);
+        if (memo)
+            memo->store(key, nativeResult);
+        return nativeResult;
+    }
+    stack.resize(base + func->frameSize);
+    size_t savedBase = frameBase;
+    const SourceMap* savedMap = sourceMap;
+    Profile* savedProfile = currentProfile;
+    frameBase = base;
+    Flow flow;
+    while (true) {
+        sourceMap = func->sourceMap ? func->sourceMap.get() : savedMap;
+        currentProfile = calleeProfile;
+        flow = execBody(func->body);
+        if (flow != Flow::RETURN || !tailCallee)
+            break;
+        func = tailCallee;
+        tailCallee = nullptr;
+        calleeProfile = &profile(*func);
+        ++calleeProfile->calls;
+    }
+    stack.resize(base);
+    frameBase = savedBase;
+    sourceMap = savedMap;
+    currentProfile = savedProfile;
+    if (flow == Flow::BREAK || flow == Flow::CONTINUE)
+        error("'break' or 'continue' outside of a loop in function " + SymbolTable::name(func->name), expr.position);
+    Value result = flow == Flow::RETURN ? std::move(returnValue) : Value();
+    if (memo)
+        memo->store(key, result);
+    return result;
+}
+// Profiles are keyed by definition, so they are reported and dropped
+// when the program's functions change, along with the native tier
+// compiled from the old definitions.
+Evaluator::Profile& Evaluator::profile(const FunctionDef& func) {
+    if (profileVersion != program.functionVersion) {
+        flushProfiles();
+        profileVersion = program.functionVersion;
+    }
+    auto [entry, added] = profiles.try_emplace(&func);
+    if (added)
+        entry->second.name = func.name;
+    return entry->second;
+}
+void Evaluator::countLoop(const Stmt& loop, uint64_t iterations) {
+    auto [entry, added] = loopProfiles.try_emplace(&loop);
+    if (added) {
+        entry->second.function = currentProfile ? SymbolTable::name(currentProfile->name) : "<main>";
+        entry->second.line = sourceMap->locate(loop.position).line;
+    }
+    entry->second.iterations += iterations;
+    if (currentProfile)
+        currentProfile->iterations += iterations;
+}
+// Only pure functions can leave the ast: native code cannot see globals or
+// write output. The whole program is compiled to bytecode once, at the
+// first promotion; cold code never gets that far.
+void Evaluator::tierUp(const FunctionDef& func, Profile& profile) {
+    if (!func.pure) {
+        profile.tier = "ast, not pure";
+        return;
+    }
+    if (!Jit::enabled()) {
+        profile.tier = "ast, jit off";
+        return;
+    }
+    if (!nativeTier) {
+        nativeTier = std::make_unique<NativeTier>();
+        nativeTier->compiled = Compiler(program).compile();
+        nativeTier->jit = std::make_unique<Jit>(nativeTier->compiled);
+        for (size_t i = 1; i < nativeTier->compiled.functions.size(); ++i)
+            nativeTier->functionIndex[SymbolTable::intern(nativeTier->compiled.functions[i].name)] = static_cast<int>(i);
+    }
+    auto found = nativeTier->functionIndex.find(func.name);
+    if (found == nativeTier->functionIndex.end() || !nativeTier->jit->promote(found->second)) {
+        profile.tier = "ast, not compilable";
+        return;
+    }
+    profile.native = found->second;
+    profile.promotedAt = profile.calls + profile.iterations;
+    profile.tier = "native";
+}
+void Evaluator::flushProfiles() {
+    for (const auto& [func, entry] : profiles) {
+        std::string tier = entry.tier;
+        if (!Tiering::enabled())
+            tier = "ast, tiering off";
+        else if (tier.empty())
+            tier = entry.calls + entry.iterations < Tiering::threshold() ? "ast, below threshold" : "ast, hot only after its last call";
+        else if (entry.native >= 0 && !nativeTier->jit->compilable(entry.native))
+            tier = "native, back on ast after bail-outs";
+        Tiering::recordFunction("ast", SymbolTable::name(entry.name), entry.calls, entry.iterations, entry.promotedAt, tier);
+    }
+    profiles.clear();
+    nativeTier.reset();
+    flushLoopProfiles();
+}
+void Evaluator::flushLoopProfiles() {
+    for (const auto& [loop, entry] : loopProfiles)
+        Tiering::recordLoop("ast", entry.function, entry.line, entry.iterations);
+    loopProfiles.clear();
+}
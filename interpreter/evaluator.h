@@ -0,0 +1,100 @@
+#pragma once
+#include "ast.h"
+#include "bytecode.h"
+#include "jit.h"
+#include "lexer.h"
+#include "memo.h"
+#include "output.h"
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+class Evaluator {
+public:
+    Evaluator(const Program& program, const Lexer& lexer, OutputChannel& output = OutputChannel::standard());
+    Evaluator(const Program& program, const SourceMap& sourceMap, OutputChannel& output = OutputChannel::standard());
+    ~Evaluator();
+    Evaluator(const Evaluator&) = delete;
+    Evaluator& operator=(const Evaluator&) = delete;
+    void run();
+    void execute(const Block& statements);
+    void setSourceMap(const SourceMap& map);
+    const Value* global(int index) const;
+private:
+    // A worker of a parallel for (see execParallelFor).
+    Evaluator(const Evaluator& parent, const Stmt& loop, OutputChannel& output);
+    enum class Flow {
+        NORMAL,
+        BREAK,
+        CONTINUE,
+        RETURN
+    };
+    // Hotness of one function (see Tiering); tier stays empty until the
+    // function crosses the threshold and a decision is made.
+    struct Profile {
+        Symbol name = 0;
+        uint64_t calls = 0;
+        uint64_t iterations = 0;
+        uint64_t promotedAt = 0;
+        int native = -1;
+        std::string tier;
+    };
+    struct LoopProfile {
+        std::string function;
+        int line = 0;
+        uint64_t iterations = 0;
+    };
+    // Bytecode for the whole program, compiled at the first tier-up, and
+    // the jit running promoted functions from it.
+    struct NativeTier {
+        CompiledProgram compiled;
+        std::unique_ptr<Jit> jit;
+        std::unordered_map<Symbol, int> functionIndex;
+    };
+    const Program& program;
+    const SourceMap* sourceMap;
+    OutputChannel& output;
+    std::vector<Value> stack;
+    std::vector<Value> globals;
+    std::vector<bool> globalDefined;
+    size_t frameBase = 0;
+    Value returnValue;
+    const FunctionDef* tailCallee = nullptr;
+    std::unordered_map<const FunctionDef*, std::unique_ptr<MemoTable>> memoTables;
+    uint32_t memoVersion = 0;
+    std::unordered_map<const FunctionDef*, Profile> profiles;
+    std::unordered_map<const Stmt*, LoopProfile> loopProfiles;
+    Profile* currentProfile = nullptr;
+    std::unique_ptr<NativeTier> nativeTier;
+    uint32_t profileVersion = 0;
+    // Set on workers, which leave call-site caches and tier-up to the
+    // evaluator that started the loop; only the loop's reductions among
+    // the globals may be assigned.
+    bool worker = false;
+    std::vector<bool> readOnlyGlobals;
+    Flow execBody(const Block& block);
+    Flow exec(const Stmt& stmt);
+    Flow execFor(const Stmt& stmt);
+    Flow execCountedFor(const Stmt& stmt, int64_t bound);
+    Flow execParallelFor(const Stmt& stmt);
+    void runChunk(const Stmt& loop, int64_t first, uint64_t count, int64_t* partials);
+    void absorb(std::vector<std::unique_ptr<Evaluator>>& workers);
+    void checkWritable(const Stmt& stmt) const;
+    Value eval(const Expr& expr);
+    int64_t evalInt(const Expr& expr);
+    int64_t arithmetic(bool exact, int64_t result, size_t position) const;
+    bool evalCondition(const Expr& expr);
+    Value call(const Expr& expr);
+    const FunctionDef* callee(const Expr& expr, const HostFunctions::Entry*& host);
+    Value callHost(const Expr& expr, const HostFunctions::Entry& host);
+    void prepareTailCall(const Expr& expr);
+    MemoTable& memoTable(const FunctionDef& func);
+    Profile& profile(const FunctionDef& func);
+    void countLoop(const Stmt& loop, uint64_t iterations);
+    void tierUp(const FunctionDef& func, Profile& profile);
+    void flushProfiles();
+    void flushLoopProfiles();
+    Value& load(const VarRef& ref, Symbol name, size_t position);
+    void store(const VarRef& ref, Value value);
+    void error(const std::string& message, size_t position) const;
+};
@@ -0,0 +1,32 @@
+#include "hostfunctions.h"
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+static std::unordered_map<Symbol, HostFunctions::Entry>& entries() {
+    static std::unordered_map<Symbol, HostFunctions::Entry> byName;
+    return byName;
+}
+void HostFunctions::define(std::string_view name, size_t arity, Function function) {
+    Symbol symbol = SymbolTable::intern(name);
+    Entry& entry = entries()[symbol];
+    entry.name = symbol;
+    entry.arity = arity;
+    entry.function = std::move(function);
+}
+const HostFunctions::Entry* HostFunctions::find(Symbol name) {
+    auto found = entries().find(name);
+    return found == entries().end() ? nullptr : &found->second;
+}
+uint64_t HostFunctions::signature() {
+    std::vector<std::pair<std::string_view, size_t>> names;
+    for (const auto& [symbol, entry] : entries())
+        names.emplace_back(SymbolTable::name(symbol), entry.arity);
+    std::sort(names.begin(), names.end());
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (const auto& [name, arity] : names) {
+        for (char c : name)
+            hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001B3ull;
+        hash = (hash ^ (arity + 0x100)) * 0x100000001B3ull;
+    }
+    return hash;
+}
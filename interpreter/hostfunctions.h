@@ -0,0 +1,42 @@
+#pragma once
+#include "symbols.h"
+#include "value.h"
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string_view>
+// C++ functions an embedding host exposes to scripts. Scripts call them
+// like their own functions, by name with a fixed number of arguments; a
+// script function of the same name takes precedence. Register functions
+// before scripts run, like the other process-wide settings. A function may
+// be called from several threads at once, by a parallel for or --batch.
+// Errors are reported by throwing; the engine adds the call's location.
+class HostFunctions {
+public:
+    // The call's arguments, read in place from the caller's stack; only
+    // valid until the function returns.
+    class Arguments {
+    public:
+        Arguments(const Value* values, size_t count) : values(values), count(count) {}
+        size_t size() const { return count; }
+        const Value& operator[](size_t index) const { return values[index]; }
+        const Value* begin() const { return values; }
+        const Value* end() const { return values + count; }
+    private:
+        const Value* values;
+        size_t count;
+    };
+    // The result is moved to where the call's value goes.
+    using Function = std::function<Value(Arguments)>;
+    struct Entry {
+        Symbol name;
+        size_t arity;
+        Function function;
+    };
+    // Registering a name again replaces the earlier function.
+    static void define(std::string_view name, size_t arity, Function function);
+    static const Entry* find(Symbol name);
+    // Changes whenever a name or arity does, so bytecode compiled against
+    // other host functions is not reused.
+    static uint64_t signature();
+};
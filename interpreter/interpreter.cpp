@@ -1,24 +1,136 @@
 #include "interpreter.h"
+#include "Debugger.h"
+#include "astprinter.h"
+#include "ErrorHandler.h"
+#include "astbuilder.h"
+#include "compiler.h"
+#include "evaluator.h"
+#include "optimizer.h"
 #include "parser.h"
+#include "programcache.h"
+#include "resolver.h"
+#include "session.h"
+#include "streaming.h"
+#include "vm.h"
 #include <iostream>
 #include <sstream>
+static void runProgram(std::string_view source, Engine engine, OutputChannel& output) {
+    Lexer lexer(source);
+    if (engine == Engine::PARSER) {
+        Parser parser(lexer, output);
+        parser.parse();
+        return;
+    }
+    AstBuilder builder(lexer);
+    Program program = builder.build();
+    Optimizer(program).optimize();
+    Resolver(program).resolve();
+    if (engine == Engine::VM) {
+        CompiledProgram compiled = Compiler(program).compile();
+        VM vm(compiled, lexer, output);
+        vm.run();
+        return;
+    }
+    Evaluator evaluator(program, lexer, output);
+    evaluator.run();
+}
+bool parseEngineName(const std::string& name, Engine& engine) {
+    if (name == "parser") engine = Engine::PARSER;
+    else if (name == "ast") engine = Engine::AST;
+    else if (name == "vm") engine = Engine::VM;
+    else return false;
+    return true;
+}
 void interpretLine(const std::string& line) {
+    static Session session;
     try {
-        Parser parser(line);
-        parser.statement();
+        session.eval(line);
     } catch (const std::exception& e) {
+        OutputChannel::standard().flush();
         std::cerr << "Error: " << e.what() << std::endl;
+        Debugger::dump(std::cerr);
     }
 }
-void execStatements(const std::vector<std::string>& lines) {
+void execStatements(const std::vector<std::string>& lines, Engine engine, OutputChannel& output) {
     std::string fullInput;
     for (const auto& line : lines) {
         fullInput += line + "\n";
     }
+    execSource(fullInput, engine, output);
+}
+// Reads statements line by line into one session. A line that ends inside
+// a statement is held until the statement is complete.
+void runRepl(std::istream& input, OutputChannel& output) {
+    Session session(output);
+    std::string pending;
+    std::string line;
+    while (std::getline(input, line)) {
+        pending += line;
+        pending += '\n';
+        try {
+            session.eval(pending);
+        } catch (const IncompleteInputError&) {
+            continue;
+        } catch (const std::exception& e) {
+            output.flush();
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        output.flush();
+        pending.clear();
+    }
+}
+// Runs a script on the vm engine, reusing the compiled program stored at
+// cachePath when it was built from the same source and refreshing it
+// otherwise.
+void execCached(std::string_view source, const std::string& cachePath, OutputChannel& output) {
     try {
-        Parser parser(fullInput);
-        parser.parse();
+        CompiledProgram compiled;
+        if (!ProgramCache::load(cachePath, source, compiled)) {
+            Lexer lexer(source);
+            Program program = AstBuilder(lexer).build();
+            Optimizer(program).optimize();
+            Resolver(program).resolve();
+            compiled = Compiler(program).compile();
+            ProgramCache::store(cachePath, source, compiled);
+        }
+        SourceMap sourceMap(source, scanKernels(ScanMode::AUTO));
+        VM(compiled, sourceMap, output).run();
+    } catch (const std::exception& e) {
+        output.flush();
+        std::cerr << "Error: " << e.what() << std::endl;
+        Debugger::dump(std::cerr);
+    }
+}
+void execStream(std::istream& input, OutputChannel& output) {
+    try {
+        StreamingRunner(input, output).run();
+    } catch (const std::exception& e) {
+        output.flush();
+        std::cerr << "Error: " << e.what() << std::endl;
+        Debugger::dump(std::cerr);
+    }
+}
+void dumpOptimized(std::string_view source, std::ostream& out) {
+    try {
+        Lexer lexer(source);
+        Program program = AstBuilder(lexer).build();
+        Optimizer(program).optimize();
+        printProgram(program, out);
     } catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
     }
+}
+void execSource(std::string_view source, Engine engine, OutputChannel& output) {
+    runSource(source, engine, output, std::cerr);
+}
+bool runSource(std::string_view source, Engine engine, OutputChannel& output, std::ostream& errors) {
+    try {
+        runProgram(source, engine, output);
+        return true;
+    } catch (const std::exception& e) {
+        output.flush();
+        errors << "Error: " << e.what() << std::endl;
+        Debugger::dump(errors);
+        return false;
+    }
 }
\ No newline at end of file
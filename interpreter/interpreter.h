@@ -1,7 +1,25 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
+#include "output.h"
+#include <istream>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <vector>
-void execStatements(const std::vector<std::string>& lines);
+enum class Engine {
+    PARSER,
+    AST,
+    VM
+};
+bool parseEngineName(const std::string& name, Engine& engine);
+void dumpOptimized(std::string_view source, std::ostream& out);
+void execSource(std::string_view source, Engine engine = Engine::AST, OutputChannel& output = OutputChannel::standard());
+// Like execSource, but reports an error to `errors`; false when the script
+// failed. Safe to call for different scripts on several threads at once.
+bool runSource(std::string_view source, Engine engine, OutputChannel& output, std::ostream& errors);
+void execCached(std::string_view source, const std::string& cachePath, OutputChannel& output = OutputChannel::standard());
+void execStream(std::istream& input, OutputChannel& output = OutputChannel::standard());
+void execStatements(const std::vector<std::string>& lines, Engine engine = Engine::AST, OutputChannel& output = OutputChannel::standard());
 void interpretLine(const std::string& line);
+void runRepl(std::istream& input, OutputChannel& output = OutputChannel::standard());
 #endif
\ No newline at end of file
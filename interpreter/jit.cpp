@@ -0,0 +1,537 @@
+#include "jit.h"
+#include "arithmetic.h"
+#include "tiering.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#if defined(__x86_64__) && defined(__linux__)
+#define PDEV_JIT 1
+#include <sys/mman.h>
+#endif
+static_assert(offsetof(Jit::State, stackLimit) == 8, "generated code reads the stack limit at [state + 8]");
+static bool jitEnabled = true;
+bool Jit::available() {
+#ifdef PDEV_JIT
+    return true;
+#else
+    return false;
+#endif
+}
+void Jit::setEnabled(bool on) {
+    jitEnabled = on;
+}
+bool Jit::enabled() {
+    return jitEnabled && available();
+}
+namespace {
+// Operand stack depth before each instruction, or -1 where unreachable.
+// Empty when the function uses an instruction the jit does not handle or
+// its depth is not the same along every path.
+std::vector<int> stackDepths(const CompiledProgram& program, const CompiledFunction& function, int& maxDepth) {
+    const auto& code = function.code;
+    std::vector<int> depth(code.size(), -1);
+    std::vector<size_t> work{0};
+    depth[0] = 0;
+    maxDepth = 0;
+    auto reach = [&](size_t target, int value) {
+        if (target >= code.size() || value < 0)
+            return false;
+        if (depth[target] == -1) {
+            depth[target] = value;
+            work.push_back(target);
+            return true;
+        }
+        return depth[target] == value;
+    };
+    while (!work.empty()) {
+        size_t at = work.back();
+        work.pop_back();
+        const Instruction& instruction = code[at];
+        int before = depth[at];
+        int after = before;
+        bool next = true;
+        bool ok = true;
+        switch (instruction.op) {
+            case OpCode::PUSH_INT: case OpCode::PUSH_CONST: case OpCode::LOAD_LOCAL:
+                after = before + 1;
+                break;
+            case OpCode::POP: case OpCode::STORE_LOCAL:
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::LE: case OpCode::GT: case OpCode::GE:
+            case OpCode::ADD_INT: case OpCode::SUB_INT: case OpCode::MUL_INT: case OpCode::DIV_INT:
+            case OpCode::EQ_INT: case OpCode::NE_INT: case OpCode::LT_INT: case OpCode::LE_INT: case OpCode::GT_INT:
+            case OpCode::GE_INT:
+                after = before - 1;
+                break;
+            case OpCode::NEG: case OpCode::CHECK_INT: case OpCode::INC_LOCAL:
+                break;
+            case OpCode::JUMP:
+                next = false;
+                ok = reach(instruction.arg, before);
+                break;
+            case OpCode::JUMP_IF_FALSE: case OpCode::JUMP_IF_TRUE:
+                after = before - 1;
+                ok = reach(instruction.arg, after);
+                break;
+            case OpCode::LOOP_ENTER: case OpCode::LOOP_NEXT:
+                ok = before >= 1 && reach(instruction.arg, before);
+                break;
+            case OpCode::CALL:
+                after = before - program.functions[instruction.arg].arity + 1;
+                break;
+            case OpCode::TAIL_CALL:
+                next = false;
+                ok = before >= program.functions[instruction.arg].arity;
+                break;
+            case OpCode::RETURN:
+                next = false;
+                ok = before >= 1;
+                break;
+            case OpCode::FAIL:
+                next = false;
+                break;
+            default:
+                return {};
+        }
+        if (!ok || (next && !reach(at + 1, after)) || after < 0)
+            return {};
+        maxDepth = std::max(maxDepth, std::max(before, after));
+    }
+    return depth;
+}
+#ifdef PDEV_JIT
+// Just enough of an x86-64 encoder for the templates below. Every frame
+// slot is addressed as [rsp + disp32] and holds a 64-bit integer.
+class Assembler {
+public:
+    enum Reg : uint8_t { EAX = 0, ECX = 1 };
+    std::vector<uint8_t> bytes;
+    size_t size() const { return bytes.size(); }
+    void byte(uint8_t value) { bytes.push_back(value); }
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; ++i)
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; ++i)
+            byte(static_cast<uint8_t>(value >> (8 * i)));
+    }
+    void slot(uint8_t reg, int32_t disp) {
+        byte(static_cast<uint8_t>(0x84 | (reg << 3)));
+        byte(0x24);
+        u32(static_cast<uint32_t>(disp));
+    }
+    void load(Reg reg, int32_t disp) { rexW(); byte(0x8B); slot(reg, disp); }
+    void store(int32_t disp, Reg reg) { rexW(); byte(0x89); slot(reg, disp); }
+    // Immediates are sign-extended to 64 bits.
+    void storeImmediate(int32_t disp, int32_t value) { rexW(); byte(0xC7); slot(0, disp); u32(static_cast<uint32_t>(value)); }
+    void addImmediate(int32_t disp, int32_t value) { rexW(); byte(0x81); slot(0, disp); u32(static_cast<uint32_t>(value)); }
+    void add(Reg reg, int32_t disp) { rexW(); byte(0x03); slot(reg, disp); }
+    void sub(Reg reg, int32_t disp) { rexW(); byte(0x2B); slot(reg, disp); }
+    void cmp(Reg reg, int32_t disp) { rexW(); byte(0x3B); slot(reg, disp); }
+    void imul(Reg reg, int32_t disp) { rexW(); byte(0x0F); byte(0xAF); slot(reg, disp); }
+    // Returns the offset of the rel32 field for later patching.
+    size_t jump() { byte(0xE9); u32(0); return size() - 4; }
+    size_t jumpIf(uint8_t condition) { byte(0x0F); byte(static_cast<uint8_t>(0x80 | condition)); u32(0); return size() - 4; }
+    void rexW() { byte(0x48); }
+    void patch(size_t field, size_t target) {
+        int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(field + 4));
+        std::memcpy(&bytes[field], &rel, 4);
+    }
+};
+// x86 condition codes; flipping the low bit negates one.
+constexpr uint8_t CC_O = 0x0, CC_B = 0x2, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF;
+// The unchecked *_INT forms compile the same as the checked ones, whose
+// type checks the native code does not need anyway.
+OpCode checkedForm(OpCode op) {
+    switch (op) {
+        case OpCode::ADD_INT: return OpCode::ADD;
+        case OpCode::SUB_INT: return OpCode::SUB;
+        case OpCode::MUL_INT: return OpCode::MUL;
+        case OpCode::DIV_INT: return OpCode::DIV;
+        case OpCode::EQ_INT: return OpCode::EQ;
+        case OpCode::NE_INT: return OpCode::NE;
+        case OpCode::LT_INT: return OpCode::LT;
+        case OpCode::LE_INT: return OpCode::LE;
+        case OpCode::GT_INT: return OpCode::GT;
+        case OpCode::GE_INT: return OpCode::GE;
+        default: return op;
+    }
+}
+uint8_t conditionFor(OpCode compare) {
+    switch (checkedForm(compare)) {
+        case OpCode::EQ: return CC_E;
+        case OpCode::NE: return CC_NE;
+        case OpCode::LT: return CC_L;
+        case OpCode::LE: return CC_LE;
+        case OpCode::GT: return CC_G;
+        default: return CC_GE;
+    }
+}
+struct Patch {
+    size_t field;
+    size_t target;
+};
+// Native code for one function, as offsets into the assembler's bytes:
+// the regular entry and one entry per loop, keyed by the back-edge that
+// closes it.
+struct LoopCode {
+    size_t backEdge;
+    size_t start;
+    size_t frameSlots;
+};
+struct FunctionCode {
+    size_t start = 0;
+    std::vector<LoopCode> loops;
+};
+// Frame layout: locals in slots [0, frameSize), the operand stack above
+// them; slot i lives at [rsp + 8 * i], so arguments for a call are already
+// laid out as the int64 array the callee expects, and a loop entry copies
+// the vm's frame the same way. Calls go through the entry table, so code
+// compiled at different times can call each other. With overflow trapping
+// on, an overflowing operation bails so the baseline tier reports it.
+FunctionCode compileFunction(Assembler& as, const CompiledProgram& program, int index, const std::vector<int>& depth, int maxDepth,
+                             const Jit::Entry* table) {
+    const CompiledFunction& function = program.functions[index];
+    const int frameSize = function.frameSize;
+    auto local = [](int i) { return 8 * i; };
+    auto operand = [&](int i) { return 8 * (frameSize + i); };
+    int32_t frameBytes = ((8 * (frameSize + maxDepth) + 15) & ~15) + 8;
+    std::vector<size_t> bails;
+    const bool trapOverflow = Arithmetic::trapOverflow();
+    auto checkOverflow = [&] {
+        if (trapOverflow)
+            bails.push_back(as.jumpIf(CC_O));
+    };
+    auto prologue = [&](int copied) {
+        as.byte(0x55);                                              // push rbp
+        as.byte(0x48); as.byte(0x89); as.byte(0xE5);                // mov rbp, rsp
+        as.byte(0x53);                                              // push rbx
+        as.byte(0x48); as.byte(0x89); as.byte(0xF3);                // mov rbx, rsi
+        as.byte(0x48); as.byte(0x81); as.byte(0xEC); as.u32(frameBytes); // sub rsp, frameBytes
+        as.byte(0x48); as.byte(0x3B); as.byte(0x63); as.byte(0x08); // cmp rsp, [rbx + 8]
+        bails.push_back(as.jumpIf(CC_B));
+        for (int i = 0; i < copied; ++i) {
+            as.byte(0x48); as.byte(0x8B); as.byte(0x87); as.u32(8 * i); // mov rax, [rdi + 8i]
+            as.store(local(i), Assembler::EAX);
+        }
+    };
+    FunctionCode result;
+    result.start = as.size();
+    prologue(function.arity);
+    size_t bodyStart = as.size();
+    std::vector<size_t> labels(function.code.size());
+    std::vector<Patch> jumps;
+    std::vector<size_t> exits;
+    auto emitCall = [&](int callee, int d) {
+        int arity = program.functions[callee].arity;
+        as.byte(0x48); as.byte(0x8D); as.slot(7, operand(d - arity)); // lea rdi, args
+        as.byte(0x48); as.byte(0x89); as.byte(0xDE);                 // mov rsi, rbx
+        as.byte(0x48); as.byte(0xB8); as.u64(reinterpret_cast<uintptr_t>(&table[callee])); // mov rax, &entries[callee]
+        as.byte(0xFF); as.byte(0x10);                                // call [rax]
+        as.byte(0x80); as.byte(0x3B); as.byte(0x00);                 // cmp byte [rbx], 0
+        exits.push_back(as.jumpIf(CC_NE));
+    };
+    for (size_t at = 0; at < function.code.size(); ++at) {
+        labels[at] = as.size();
+        const Instruction& ins = function.code[at];
+        int d = depth[at];
+        if (d < 0)
+            continue;
+        switch (checkedForm(ins.op)) {
+            case OpCode::PUSH_INT:
+                as.storeImmediate(operand(d), ins.arg);
+                break;
+            case OpCode::PUSH_CONST:
+                as.byte(0x48); as.byte(0xB8); as.u64(static_cast<uint64_t>(program.constants[ins.arg])); // mov rax, imm64
+                as.store(operand(d), Assembler::EAX);
+                break;
+            case OpCode::POP: case OpCode::CHECK_INT:
+                break;
+            case OpCode::LOAD_LOCAL:
+                as.load(Assembler::EAX, local(ins.arg));
+                as.store(operand(d), Assembler::EAX);
+                break;
+            case OpCode::STORE_LOCAL:
+                as.load(Assembler::EAX, operand(d - 1));
+                as.store(local(ins.arg), Assembler::EAX);
+                break;
+            case OpCode::ADD: case OpCode::SUB: case OpCode::MUL:
+                as.load(Assembler::EAX, operand(d - 2));
+                if (checkedForm(ins.op) == OpCode::ADD) as.add(Assembler::EAX, operand(d - 1));
+                else if (checkedForm(ins.op) == OpCode::SUB) as.sub(Assembler::EAX, operand(d - 1));
+                else as.imul(Assembler::EAX, operand(d - 1));
+                checkOverflow();
+                as.store(operand(d - 2), Assembler::EAX);
+                break;
+            case OpCode::DIV: {
+                as.load(Assembler::ECX, operand(d - 1));
+                as.byte(0x48); as.byte(0x85); as.byte(0xC9);    // test rcx, rcx
+                bails.push_back(as.jumpIf(CC_E));
+                as.load(Assembler::EAX, operand(d - 2));
+                as.byte(0x48); as.byte(0x83); as.byte(0xF9); as.byte(0xFF); // cmp rcx, -1
+                size_t divide = as.jumpIf(CC_NE);
+                as.byte(0x48); as.byte(0xF7); as.byte(0xD8);    // neg rax (INT64_MIN / -1 would trap)
+                checkOverflow();
+                size_t done = as.jump();
+                as.patch(divide, as.size());
+                as.byte(0x48); as.byte(0x99);                   // cqo
+                as.byte(0x48); as.byte(0xF7); as.byte(0xF9);    // idiv rcx
+                as.patch(done, as.size());
+                as.store(operand(d - 2), Assembler::EAX);
+                break;
+            }
+            case OpCode::NEG:
+                as.load(Assembler::EAX, operand(d - 1));
+                as.byte(0x48); as.byte(0xF7); as.byte(0xD8);    // neg rax
+                checkOverflow();
+                as.store(operand(d - 1), Assembler::EAX);
+                break;
+            case OpCode::EQ: case OpCode::NE: case OpCode::LT: case OpCode::LE: case OpCode::GT: case OpCode::GE:
+                as.load(Assembler::EAX, operand(d - 2));
+                as.cmp(Assembler::EAX, operand(d - 1));
+                as.byte(0x0F); as.byte(static_cast<uint8_t>(0x90 | conditionFor(ins.op))); as.byte(0xC0); // setcc al
+                as.byte(0x0F); as.byte(0xB6); as.byte(0xC0);    // movzx eax, al
+                as.store(operand(d - 2), Assembler::EAX);
+                break;
+            case OpCode::JUMP:
+                jumps.push_back({as.jump(), static_cast<size_t>(ins.arg)});
+                break;
+            case OpCode::JUMP_IF_FALSE: case OpCode::JUMP_IF_TRUE:
+                as.load(Assembler::EAX, operand(d - 1));
+                as.byte(0x48); as.byte(0x85); as.byte(0xC0);    // test rax, rax
+                jumps.push_back({as.jumpIf(ins.op == OpCode::JUMP_IF_FALSE ? CC_E : CC_NE), static_cast<size_t>(ins.arg)});
+                break;
+            case OpCode::INC_LOCAL:
+                as.addImmediate(local(ins.slot), ins.arg);
+                checkOverflow();
+                break;
+            case OpCode::LOOP_ENTER: case OpCode::LOOP_NEXT: {
+                as.load(Assembler::EAX, local(ins.slot));
+                as.cmp(Assembler::EAX, operand(d - 1));
+                uint8_t condition = conditionFor(ins.compare);
+                if (ins.op == OpCode::LOOP_ENTER)
+                    condition ^= 1;
+                jumps.push_back({as.jumpIf(condition), static_cast<size_t>(ins.arg)});
+                break;
+            }
+            case OpCode::CALL:
+                emitCall(ins.arg, d);
+                as.store(operand(d - program.functions[ins.arg].arity), Assembler::EAX);
+                break;
+            case OpCode::TAIL_CALL: {
+                int arity = program.functions[ins.arg].arity;
+                if (ins.arg != index) {
+                    emitCall(ins.arg, d);
+                    exits.push_back(as.jump());
+                    break;
+                }
+                for (int i = 0; i < arity; ++i) {
+                    as.load(Assembler::EAX, operand(d - arity + i));
+                    as.store(local(i), Assembler::EAX);
+                }
+                size_t loop = as.jump();
+                as.patch(loop, bodyStart);
+                break;
+            }
+            case OpCode::RETURN:
+                as.load(Assembler::EAX, operand(d - 1));
+                exits.push_back(as.jump());
+                break;
+            case OpCode::FAIL:
+                bails.push_back(as.jump());
+                break;
+            default:
+                break;
+        }
+    }
+    for (const Patch& jump : jumps)
+        as.patch(jump.field, labels[jump.target]);
+    for (size_t at = 0; at < function.code.size(); ++at) {
+        const Instruction& ins = function.code[at];
+        bool backEdge = ins.op == OpCode::LOOP_NEXT ||
+                        ((ins.op == OpCode::JUMP || ins.op == OpCode::JUMP_IF_TRUE) && static_cast<size_t>(ins.arg) <= at);
+        if (!backEdge || depth[at] < 0)
+            continue;
+        result.loops.push_back({at, as.size(), static_cast<size_t>(frameSize + depth[ins.arg])});
+        prologue(frameSize + depth[ins.arg]);
+        as.patch(as.jump(), labels[ins.arg]);
+    }
+    size_t bail = as.size();
+    as.byte(0xC6); as.byte(0x03); as.byte(0x01);                // mov byte [rbx], 1
+    size_t epilogue = as.size();
+    as.byte(0x48); as.byte(0x8D); as.byte(0x65); as.byte(0xF8); // lea rsp, [rbp - 8]
+    as.byte(0x5B);                                              // pop rbx
+    as.byte(0x5D);                                              // pop rbp
+    as.byte(0xC3);                                              // ret
+    for (size_t field : bails)
+        as.patch(field, bail);
+    for (size_t field : exits)
+        as.patch(field, epilogue);
+    return result;
+}
+#endif
+}
+static uint64_t loopKey(int function, size_t backEdge) {
+    return static_cast<uint64_t>(function) << 32 | backEdge;
+}
+Jit::Jit(const CompiledProgram& program)
+    : program(program), eligible(program.functions.size(), 0), callCounts(program.functions.size(), 0),
+      iterationCounts(program.functions.size(), 0), promotedHotness(program.functions.size(), 0),
+      bails(program.functions.size(), 0), entries(program.functions.size(), nullptr) {
+    findEligible();
+}
+Jit::~Jit() {
+#ifdef PDEV_JIT
+    for (const auto& [memory, size] : regions)
+        munmap(memory, size);
+#endif
+}
+// A function qualifies when its own code is supported and everything it
+// calls qualifies too; dropping callers of unsupported functions until
+// nothing changes keeps recursive groups together.
+void Jit::findEligible() {
+    for (size_t i = 1; i < program.functions.size(); ++i) {
+        int maxDepth;
+        if (!stackDepths(program, program.functions[i], maxDepth).empty())
+            eligible[i] = 1;
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 1; i < program.functions.size(); ++i) {
+            if (!eligible[i])
+                continue;
+            for (const Instruction& ins : program.functions[i].code) {
+                if ((ins.op == OpCode::CALL || ins.op == OpCode::TAIL_CALL) && !eligible[ins.arg]) {
+                    eligible[i] = 0;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+bool Jit::hot(int function) const {
+    return Tiering::enabled() && callCounts[function] + iterationCounts[function] >= Tiering::threshold();
+}
+// Compiles the function together with whatever it can call that is not
+// native yet, since native code never calls back into the vm.
+void Jit::compile(int function) {
+#ifdef PDEV_JIT
+    std::vector<int> pending{function};
+    std::vector<uint8_t> queued(program.functions.size(), 0);
+    queued[function] = 1;
+    for (size_t next = 0; next < pending.size(); ++next) {
+        for (const Instruction& ins : program.functions[pending[next]].code) {
+            if ((ins.op == OpCode::CALL || ins.op == OpCode::TAIL_CALL) && !queued[ins.arg] && !entries[ins.arg]) {
+                queued[ins.arg] = 1;
+                pending.push_back(ins.arg);
+            }
+        }
+    }
+    Assembler as;
+    std::vector<FunctionCode> compiled;
+    for (int index : pending) {
+        int maxDepth;
+        std::vector<int> depth = stackDepths(program, program.functions[index], maxDepth);
+        compiled.push_back(compileFunction(as, program, index, depth, maxDepth, entries.data()));
+    }
+    size_t size = (as.size() + 4095) & ~static_cast<size_t>(4095);
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        eligible[function] = 0;
+        return;
+    }
+    std::memcpy(memory, as.bytes.data(), as.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        eligible[function] = 0;
+        return;
+    }
+    regions.push_back({memory, size});
+    uint8_t* base = static_cast<uint8_t*>(memory);
+    for (size_t i = 0; i < pending.size(); ++i) {
+        int index = pending[i];
+        entries[index] = reinterpret_cast<Entry>(base + compiled[i].start);
+        promotedHotness[index] = std::max<uint64_t>(1, callCounts[index] + iterationCounts[index]);
+        for (const LoopCode& loop : compiled[i].loops)
+            loopEntries[loopKey(index, loop.backEdge)] = {reinterpret_cast<Entry>(base + loop.start), loop.frameSlots};
+    }
+#else
+    eligible[function] = 0;
+#endif
+}
+bool Jit::promote(int function) {
+    if (eligible[function] && !entries[function])
+        compile(function);
+    return eligible[function] && entries[function];
+}
+size_t Jit::compiledFunctions() const {
+    return std::count_if(entries.begin(), entries.end(), [](Entry entry) { return entry != nullptr; });
+}
+std::string Jit::tier(int function) const {
+    if (entries[function])
+        return eligible[function] ? "native" : "native, back on vm after bail-outs";
+    if (!eligible[function])
+        return "vm, not compilable";
+    return Tiering::enabled() ? "vm, below threshold" : "vm, tiering off";
+}
+bool Jit::run(int function, Entry entry, State& state, int64_t& result) {
+    // Native frames may use up to a quarter of a typical 8 MiB stack
+    // below this one before bailing out to the vm's heap frames.
+    state.stackLimit = reinterpret_cast<uintptr_t>(&state) - (2u << 20);
+    result = entry(scratch.data(), &state);
+    if (!state.bail)
+        return true;
+    if (++bails[function] >= MAX_BAILS)
+        eligible[function] = 0;
+    return false;
+}
+bool Jit::call(int function, const Value* args, int64_t& result) {
+    if (!eligible[function] || !entries[function])
+        return false;
+    int arity = program.functions[function].arity;
+    scratch.resize(arity);
+    for (int i = 0; i < arity; ++i) {
+        if (!args[i].isInt())
+            return false;
+        scratch[i] = args[i].asInt();
+    }
+    State state;
+    return run(function, entries[function], state, result);
+}
+bool Jit::tryCall(int function, const Value* args, int64_t& result) {
+    ++callCounts[function];
+    if (!eligible[function])
+        return false;
+    if (!entries[function]) {
+        if (!hot(function))
+            return false;
+        compile(function);
+    }
+    return call(function, args, result);
+}
+bool Jit::tryLoop(int function, size_t backEdge, const Value* frame, size_t count, int64_t& result) {
+    iterationCounts[function] += LOOP_SAMPLE;
+    if (!eligible[function])
+        return false;
+    if (!entries[function]) {
+        if (!hot(function))
+            return false;
+        compile(function);
+        if (!entries[function])
+            return false;
+    }
+    auto found = loopEntries.find(loopKey(function, backEdge));
+    if (found == loopEntries.end() || found->second.count != count)
+        return false;
+    scratch.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        if (!frame[i].isInt())
+            return false;
+        scratch[i] = frame[i].asInt();
+    }
+    State state;
+    return run(function, found->second.entry, state, result);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "bytecode.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// Native x86-64 tier for the vm. Only functions that touch nothing but
+// integer locals, arguments and other such functions are compiled: no
+// strings, globals or output. Since they have no side effects, any
+// surprise at run time (a string argument, division by zero, a deep
+// recursion) simply abandons the native call and the vm runs it again.
+class Jit {
+public:
+    // Shared with generated code: bail is set when a native call gives up,
+    // and frames below stackLimit give up rather than overflow the stack.
+    struct State {
+        uint8_t bail = 0;
+        uintptr_t stackLimit = 0;
+    };
+    using Entry = int64_t (*)(const int64_t* args, State* state);
+    // Back-edges the vm takes between two calls to tryLoop.
+    static constexpr uint32_t LOOP_SAMPLE = 256;
+    // Bail-outs after which a function is no longer entered natively; a
+    // recursion too deep for the native stack would otherwise rerun its
+    // whole native part from every interpreted level.
+    static constexpr uint8_t MAX_BAILS = 4;
+    // True on x86-64 Linux builds, where executable memory is available.
+    static bool available();
+    static void setEnabled(bool on);
+    static bool enabled();
+    explicit Jit(const CompiledProgram& program);
+    ~Jit();
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+    // Counts a call and runs the function natively once it is hot (see
+    // Tiering). False means the caller has to interpret the call: the
+    // function is cold or not compilable, an argument is not an integer,
+    // or the native code bailed out.
+    bool tryCall(int function, const Value* args, int64_t& result);
+    // Counts LOOP_SAMPLE iterations of the loop closed by the back-edge at
+    // `backEdge`. Once the function is hot, the rest of the call runs
+    // natively from the loop header, starting from the frame's `count`
+    // locals and operands; false leaves the frame to the vm as it was.
+    bool tryLoop(int function, size_t backEdge, const Value* frame, size_t count, int64_t& result);
+    // For a baseline tier that keeps its own counters: compiles the
+    // function now, and calls it without counting.
+    bool promote(int function);
+    bool call(int function, const Value* args, int64_t& result);
+    bool compilable(int function) const { return eligible[function] != 0; }
+    bool promoted(int function) const { return entries[function] != nullptr; }
+    // Profile for the stats dump. Hotness counts loop iterations
+    // LOOP_SAMPLE at a time, so the vm counts loops for the dump itself.
+    uint64_t calls(int function) const { return callCounts[function]; }
+    uint64_t promotedAt(int function) const { return promotedHotness[function]; }
+    std::string tier(int function) const;
+    size_t compiledFunctions() const;
+private:
+    struct LoopEntry {
+        Entry entry;
+        size_t count;
+    };
+    const CompiledProgram& program;
+    std::vector<uint8_t> eligible;
+    std::vector<uint64_t> callCounts;
+    std::vector<uint64_t> iterationCounts;
+    std::vector<uint64_t> promotedHotness;
+    std::vector<uint8_t> bails;
+    // Sized once, so generated code can call through a fixed address.
+    std::vector<Entry> entries;
+    std::unordered_map<uint64_t, LoopEntry> loopEntries;
+    std::vector<int64_t> scratch;
+    std::vector<std::pair<void*, size_t>> regions;
+    void findEligible();
+    void compile(int function);
+    bool hot(int function) const;
+    bool run(int function, Entry entry, State& state, int64_t& result);
+};
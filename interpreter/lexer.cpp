@@ -1,168 +1,202 @@
 #include "lexer.h"
-#include <cctype>
+#include "ErrorHandler.h"
+#include <algorithm>
+#include <cstring>
 #include <stdexcept>
-Lexer::Lexer(const std::string& input) : input(input), pos(0) {}
-char Lexer::peek() {
-    return pos < input.size() ? input[pos] : '\0';
-}
-char Lexer::get() {
-    if (pos >= input.size()) return '\0';
-    char c = input[pos++];
-    if (c == '\n') {
-        lineNumber++;
-    }
-    return c;
+Lexer::Lexer(std::string_view input, ScanMode mode, SourceLocation origin) : source(input) {
+    tokenize(mode, origin);
 }
 int Lexer::getLineNumber(size_t position) const {
-    if (position > input.size())
-        position = input.size();
-    int line = 1;
-    for (size_t i = 0; i < position; ++i) {
-        if (input[i] == '\n')
-            ++line;
-    }
-    return line;
+    return sourceMap.line(position);
+}
+SourceLocation Lexer::getLocation(size_t position) const {
+    return sourceMap.locate(position);
+}
+const SourceMap& Lexer::getSourceMap() const {
+    return sourceMap;
 }
-void Lexer::setLineNumber(int newLine) {
-    lineNumber = newLine;
+size_t Lexer::tokenAt(size_t position) const {
+    auto next = std::upper_bound(tokens.begin(), tokens.end(), position,
+                                 [](size_t pos, const Token& tok) { return pos < tok.position; });
+    return next == tokens.begin() ? 0 : static_cast<size_t>(next - tokens.begin()) - 1;
 }
 size_t Lexer::getPosition() const {
-    return pos;
+    return index;
 }
 void Lexer::setPosition(size_t p) {
-    pos = p;
-    hasBufferedToken=false;
+    index = std::min(p, tokens.size() - 1);
 }
-Token Lexer::peekToken() {
-    if (!hasBufferedToken) {
-        bufferedToken = nextToken();
-        hasBufferedToken = true;
-    }
-    return bufferedToken;
+Token Lexer::peekToken() const {
+    return tokens[index];
 }
 Token Lexer::nextToken() {
-    if (hasBufferedToken) {
-        hasBufferedToken = false;
-        return bufferedToken;
-    }
-    while (true) {
-        while (isspace(peek())) get();
-        if (peek() == '/' && pos + 1 < input.size() && input[pos + 1] == '/') {
-            get(); get();
-            while (peek() != '\n' && peek() != '\0') get();
-            continue;
-        }
-        if (peek() == '/' && pos + 1 < input.size() && input[pos + 1] == '*') {
-            get(); get();
-            while (!(peek() == '*' && pos + 1 < input.size() && input[pos + 1] == '/')) {
-                if (peek() == '\0') {
-                    throw std::runtime_error("Unterminated multi-line comment");
-                }
-                get();
-            }
-            get(); get(); 
-            continue; 
-        }
-        break; 
-    }
-    if (pos >= input.size()) {
-        return {Token::END, ""};
-    }
-    char current = peek();
-    if (isdigit(current)) {
-        std::string num;
-        while (isdigit(peek())) num.push_back(get());
-        return {Token::NUM, num};
-    }
-    if (isalpha(current) || current == '_') {
-        std::string var;
-        while (isalnum(peek()) || peek() == '_') var.push_back(get());
-        if (var == "function") return {Token::FUNCTION, var};
-        if (var == "write") return {Token::WRITE, var};
-        if (var == "for") return {Token::FOR, var};
-        if (var == "do") return {Token::DO, var};
-        if (var == "while") return {Token::WHILE, var};
-        if (var == "break") return {Token::BREAK, var};
-        if (var == "continue") return {Token::CONTINUE, var};
-        if (var == "pass") return {Token::PASS, var};
-        if (var == "if") return {Token::IF, var};
-        if (var == "elif") return {Token::ELIF, var};
-        if (var == "else") return {Token::ELSE, var};
-        if (var == "return") return {Token::RETURN, var};
-        return {Token::VAR, var};
-    }
-    switch (current) {
-        case '=':
-            get();
-            if (peek() == '=') {
-                get();
-                return {Token::EQUAL, "=="};
-            }
-            return {Token::ASSIGN, "="};
-
-        case '!':
-            get();
-            if (peek() == '=') {
-                get();
-                return {Token::NOT_EQUAL, "!="};
+    const Token& tok = tokens[index];
+    if (index + 1 < tokens.size())
+        ++index;
+    return tok;
+}
+std::string_view Lexer::text(const Token& tok) const {
+    size_t start = tok.type == Token::STRING ? tok.position + 1 : tok.position;
+    return std::string_view(source.data() + start, tok.length);
+}
+// False once the literal no longer fits in 64 bits.
+static bool appendDigit(int64_t& value, char digit) {
+    if (value > (INT64_MAX - (digit - '0')) / 10)
+        return false;
+    value = value * 10 + (digit - '0');
+    return true;
+}
+int64_t Lexer::number(const Token& tok) const {
+    if (tok.value >= 0)
+        return tok.value;
+    int64_t value = 0;
+    for (char digit : text(tok))
+        appendDigit(value, digit);
+    return value;
+}
+const std::vector<Token>& Lexer::getTokens() const {
+    return tokens;
+}
+static bool matches(const char* word, const char* keyword, size_t length) {
+    return std::memcmp(word, keyword, length) == 0;
+}
+static Token::Type keywordType(const char* word, size_t length) {
+    switch (length) {
+        case 2:
+            if (matches(word, "if", 2)) return Token::IF;
+            if (matches(word, "do", 2)) return Token::DO;
+            break;
+        case 3:
+            if (matches(word, "for", 3)) return Token::FOR;
+            break;
+        case 4:
+            switch (word[0]) {
+                case 'p': if (matches(word, "pass", 4)) return Token::PASS; break;
+                case 't': if (matches(word, "true", 4)) return Token::TRUE; break;
+                case 'e':
+                    if (matches(word, "elif", 4)) return Token::ELIF;
+                    if (matches(word, "else", 4)) return Token::ELSE;
+                    break;
             }
-            throw std::runtime_error("Unexpected token '!'");
-        
-        case '<':
-            get();
-            if (peek() == '=') {
-                get();
-                return {Token::LESS_EQUAL, "<="};
+            break;
+        case 5:
+            switch (word[0]) {
+                case 'w':
+                    if (matches(word, "write", 5)) return Token::WRITE;
+                    if (matches(word, "while", 5)) return Token::WHILE;
+                    break;
+                case 'b': if (matches(word, "break", 5)) return Token::BREAK; break;
+                case 'f': if (matches(word, "false", 5)) return Token::FALSE; break;
             }
-            return {Token::LESS, "<"};
-
-        case '>':
-            get();
-            if (peek() == '=') {
-                get();
-                return {Token::GREATER_EQUAL, ">="};
+            break;
+        case 6:
+            if (matches(word, "return", 6)) return Token::RETURN;
+            break;
+        case 8:
+            if (matches(word, "function", 8)) return Token::FUNCTION;
+            if (matches(word, "continue", 8)) return Token::CONTINUE;
+            break;
+    }
+    return Token::VAR;
+}
+void Lexer::tokenize(ScanMode mode, SourceLocation origin) {
+    const size_t size = source.size();
+    const char* data = source.data();
+    const ScanKernels& scan = scanKernels(mode);
+    size_t pos = 0;
+    auto peekAt = [&](size_t at) { return at < size ? data[at] : '\0'; };
+    auto push = [&](Token::Type type, size_t start, size_t length) {
+        tokens.push_back({type, static_cast<uint32_t>(start), static_cast<uint32_t>(length)});
+    };
+    tokens.reserve(size / 4 + 1);
+    while (true) {
+        if (pos < size && hasCharClass(data[pos], CHAR_SPACE))
+            pos = scan.skipWhitespace(data, pos, size);
+        if (pos + 1 < size && data[pos] == '/') {
+            if (data[pos + 1] == '/') {
+                pos = scan.findByte(data, pos + 2, size, '\n');
+                continue;
             }
-            return {Token::GREATER, ">"};
-        case '"': {
-            get();  
-            std::string str;
-            while (peek() != '"' && peek() != '\0') {
-                str.push_back(get());
+            if (data[pos + 1] == '*') {
+                pos = scan.findCommentEnd(data, pos + 2, size);
+                if (pos >= size)
+                    throw IncompleteInputError("Unterminated multi-line comment");
+                pos += 2;
+                continue;
             }
-            if (peek() == '"') get(); 
-            else throw std::runtime_error("Unterminated string literal");
-            return {Token::STRING, str};
         }
-        case '-': {
-            get(); 
-            if (peek() == '>') {
-                get();
-                return {Token::ARROW, "->"};
-            }
-            if (peek() == '-') {
-                get(); 
-                return {Token::DECREMENT, "--"};
+        if (pos >= size)
+            break;
+        size_t start = pos;
+        char current = data[pos];
+        uint8_t cls = charClasses[static_cast<unsigned char>(current)];
+        if (cls & CHAR_DIGIT) {
+            int64_t value = 0;
+            while (pos < size && hasCharClass(data[pos], CHAR_DIGIT)) {
+                if (!appendDigit(value, data[pos++]))
+                    throw std::runtime_error("Integer literal out of range: " + std::string(data + start, pos - start));
             }
-            return {Token::OP, "-"};
+            push(Token::NUM, start, pos - start);
+            tokens.back().value = value <= INT32_MAX ? static_cast<int32_t>(value) : -1;
+            continue;
         }
-        case '+': {
-            get(); 
-            if (peek() == '+') {
-                get(); 
-                return {Token::INCREMENT, "++"};
-            }
-            return {Token::OP, "+"};
+        if (cls & CHAR_IDENT_START) {
+            pos = scan.skipIdentifier(data, pos + 1, size);
+            Token::Type type = keywordType(data + start, pos - start);
+            push(type, start, pos - start);
+            if (type == Token::VAR)
+                tokens.back().symbol = SymbolTable::intern(std::string_view(data + start, pos - start));
+            continue;
         }
-        case '*': case '/': {
-            char op = get();
-            return {Token::OP, std::string(1, op)};
+        char next = peekAt(pos + 1);
+        switch (current) {
+            case '=':
+                if (next == '=') push(Token::EQUAL, start, 2);
+                else push(Token::ASSIGN, start, 1);
+                break;
+            case '!':
+                if (next != '=')
+                    throw std::runtime_error("Unexpected token '!'");
+                push(Token::NOT_EQUAL, start, 2);
+                break;
+            case '<':
+                if (next == '=') push(Token::LESS_EQUAL, start, 2);
+                else push(Token::LESS, start, 1);
+                break;
+            case '>':
+                if (next == '=') push(Token::GREATER_EQUAL, start, 2);
+                else push(Token::GREATER, start, 1);
+                break;
+            case '"': {
+                size_t end = scan.findByte(data, start + 1, size, '"');
+                if (end >= size)
+                    throw IncompleteInputError("Unterminated string literal");
+                push(Token::STRING, start, end - start - 1);
+                tokens.back().symbol = SymbolTable::intern(std::string_view(data + start + 1, end - start - 1));
+                pos = end + 1;
+                continue;
+            }
+            case '-':
+                if (next == '>') push(Token::ARROW, start, 2);
+                else if (next == '-') push(Token::DECREMENT, start, 2);
+                else push(Token::OP, start, 1);
+                break;
+            case '+':
+                if (next == '+') push(Token::INCREMENT, start, 2);
+                else push(Token::OP, start, 1);
+                break;
+            case '*': case '/': push(Token::OP, start, 1); break;
+            case '(': push(Token::LPAREN, start, 1); break;
+            case ')': push(Token::RPAREN, start, 1); break;
+            case '{': push(Token::LBRACE, start, 1); break;
+            case '}': push(Token::RBRACE, start, 1); break;
+            case ',': push(Token::COMMA, start, 1); break;
+            case ';': push(Token::SEMICOLON, start, 1); break;
+            default:
+                throw std::runtime_error(std::string("Unknown character: ") + current);
         }
-        case '(': get(); return {Token::LPAREN, "("};
-        case ')': get(); return {Token::RPAREN, ")"};
-        case '{': get(); return {Token::LBRACE, "{"};
-        case '}': get(); return {Token::RBRACE, "}"};
-        case ',': get(); return {Token::COMMA, ","};
-        case ';': get(); return {Token::SEMICOLON, ";"};
+        pos += tokens.back().length;
     }
-    throw std::runtime_error(std::string("Unknown character: ") + get());
-}
\ No newline at end of file
+    push(Token::END, size, 0);
+    sourceMap = SourceMap(std::string_view(data, size), scan, origin);
+}
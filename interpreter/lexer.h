@@ -1,34 +1,53 @@
 #pragma once
+#include "scanner.h"
+#include "sourcemap.h"
+#include "symbols.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 struct Token {
-    enum Type {
+    enum Type : uint8_t {
         NUM, VAR, OP, LPAREN, RPAREN,
         LBRACE, RBRACE, SEMICOLON, ARROW,
-        FUNCTION, WRITE, END, STRING, 
-        IF, ELSE, EQUAL, NOT_EQUAL, LESS, 
+        FUNCTION, WRITE, END, STRING,
+        IF, ELSE, EQUAL, NOT_EQUAL, LESS,
         GREATER, LESS_EQUAL, GREATER_EQUAL,
         ASSIGN, COMMA, RETURN, ELIF, CONTINUE,
         FOR, WHILE, DO, PASS, BREAK, INCREMENT,
-        DECREMENT
+        DECREMENT, TRUE, FALSE
     } type;
-    std::string text;
+    uint32_t position = 0;
+    uint32_t length = 0;
+    // A NUM literal too wide for `value` leaves it at -1 (literals are
+    // never negative); Lexer::number() decodes those again from the text.
+    union {
+        int32_t value = 0;
+        Symbol symbol;
+    };
 };
 class Lexer {
 public:
-    Lexer(const std::string& input);
+    // The lexer does not copy its input; the caller keeps it alive for as
+    // long as the lexer and anything holding its tokens.
+    // `origin` is where the input starts when it is one window of a larger
+    // script, so reported locations stay file-relative.
+    Lexer(std::string_view input, ScanMode mode = ScanMode::AUTO, SourceLocation origin = {1, 1});
     Token nextToken();
-    char peek();
-    char get();
     size_t getPosition() const;
     void setPosition(size_t pos);
-    Token peekToken();
+    Token peekToken() const;
+    std::string_view text(const Token& tok) const;
+    int64_t number(const Token& tok) const;
     int getLineNumber(size_t position) const;
-    void setLineNumber(int newLine);
+    SourceLocation getLocation(size_t position) const;
+    size_t tokenAt(size_t position) const;
+    const SourceMap& getSourceMap() const;
+    const std::vector<Token>& getTokens() const;
 private:
-    std::string input;
-    size_t pos;
-    bool hasBufferedToken = false;
-    Token bufferedToken;
-    int lineNumber = 1;
-};
\ No newline at end of file
+    std::string_view source;
+    std::vector<Token> tokens;
+    SourceMap sourceMap;
+    size_t index = 0;
+    void tokenize(ScanMode mode, SourceLocation origin);
+};
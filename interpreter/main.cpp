@@ -1,25 +1,197 @@
 #include "interpreter.h"
-#include <iostream>
+#include "Debugger.h"
+#include "arithmetic.h"
+#include "batch.h"
+#include "benchmark.h"
+#include "jit.h"
+#include "memo.h"
+#include "memory.h"
+#include "output.h"
+#include "programcache.h"
+#include "scriptfile.h"
+#include "threadpool.h"
+#include "tiering.h"
 #include <fstream>
-#include <vector>
+#include <iostream>
 #include <string>
+#include <vector>
+static void printStats(uint64_t allocationsBefore, uint64_t bytesBefore) {
+    std::cerr << "Heap allocations: " << HeapStats::allocations() - allocationsBefore
+              << " (" << HeapStats::bytesAllocated() - bytesBefore << " bytes)\n";
+    MemoTable::report(std::cerr);
+    Tiering::report(std::cerr);
+}
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: " << argv[0] << " <script-file>\n";
+    Engine engine = Engine::AST;
+    const char* scriptPath = nullptr;
+    std::vector<std::string> batchArguments;
+    std::string benchmark;
+    bool stats = false;
+    bool stream = false;
+    bool repl = false;
+    bool cache = false;
+    bool dump = false;
+    bool batch = false;
+    TraceLevel traceLevel = TraceLevel::OFF;
+    uint8_t traceCategories = TRACE_ALL;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--engine=", 0) == 0) {
+            if (!parseEngineName(arg.substr(9), engine)) {
+                std::cerr << "Unknown engine: " << arg.substr(9) << " (expected parser, ast or vm)\n";
+                return 1;
+            }
+        } else if (arg.rfind("--trace=", 0) == 0) {
+            if (!Debugger::parseLevel(arg.substr(8), traceLevel)) {
+                std::cerr << "Unknown trace level: " << arg.substr(8) << " (expected off, info, debug or verbose)\n";
+                return 1;
+            }
+        } else if (arg.rfind("--trace-categories=", 0) == 0) {
+            if (!Debugger::parseCategories(arg.substr(19), traceCategories)) {
+                std::cerr << "Unknown trace categories: " << arg.substr(19) << " (expected lexer, parser, scopes, calls, loops or all)\n";
+                return 1;
+            }
+        } else if (arg == "--trace-echo") {
+            Debugger::setEcho(true);
+        } else if (arg.rfind("--flush=", 0) == 0) {
+            OutputChannel::Flush policy;
+            size_t threshold;
+            if (!OutputChannel::parsePolicy(arg.substr(8), policy, threshold)) {
+                std::cerr << "Unknown flush policy: " << arg.substr(8) << " (expected auto, line, exit or a byte count)\n";
+                return 1;
+            }
+            OutputChannel::standard().setPolicy(policy, threshold);
+        } else if (arg.rfind("--output=", 0) == 0) {
+            if (!OutputChannel::standard().redirect(arg.substr(9))) {
+                std::cerr << "Failed to open output file: " << arg.substr(9) << "\n";
+                return 1;
+            }
+        } else if (arg.rfind("--memo=", 0) == 0) {
+            std::string entries = arg.substr(7);
+            if (entries == "off") {
+                MemoTable::setCapacity(0);
+            } else if (!entries.empty() && entries.find_first_not_of("0123456789") == std::string::npos) {
+                MemoTable::setCapacity(std::stoul(entries));
+            } else {
+                std::cerr << "Unknown memo setting: " << entries << " (expected off or an entry count)\n";
+                return 1;
+            }
+        } else if (arg.rfind("--tier=", 0) == 0) {
+            std::string hotness = arg.substr(7);
+            if (hotness == "off") {
+                Tiering::setThreshold(0);
+            } else if (!hotness.empty() && hotness.find_first_not_of("0123456789") == std::string::npos) {
+                Tiering::setThreshold(std::stoull(hotness));
+            } else {
+                std::cerr << "Unknown tier setting: " << hotness << " (expected off or a hotness threshold)\n";
+                return 1;
+            }
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            std::string count = arg.substr(10);
+            if (count.empty() || count.find_first_not_of("0123456789") != std::string::npos) {
+                std::cerr << "Unknown thread count: " << count << " (expected 0 for one per core, or a count)\n";
+                return 1;
+            }
+            ThreadPool::setThreads(std::stoul(count));
+        } else if (arg == "--overflow=wrap" || arg == "--overflow=trap") {
+            Arithmetic::setTrapOverflow(arg == "--overflow=trap");
+        } else if (arg == "--jit=on" || arg == "--jit=off") {
+            Jit::setEnabled(arg == "--jit=on");
+        } else if (arg == "--dump-optimized") {
+            dump = true;
+        } else if (arg == "--cache") {
+            cache = true;
+        } else if (arg == "--repl") {
+            repl = true;
+        } else if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--batch") {
+            batch = true;
+        } else if (arg == "--stats") {
+            stats = true;
+        } else if (arg.rfind("--bench=", 0) == 0) {
+            benchmark = arg.substr(8);
+        } else {
+            scriptPath = argv[i];
+            batchArguments.push_back(arg);
+        }
+    }
+    Debugger::configure(traceLevel, traceCategories);
+    if (!benchmark.empty())
+        return runBenchmark(benchmark, scriptPath ? scriptPath : "");
+    if (repl) {
+        runRepl(std::cin);
+        return 0;
+    }
+    if (batch && !batchArguments.empty()) {
+        if (stream || cache || dump || repl) {
+            std::cerr << "--batch runs scripts on the parser, ast or vm engine only\n";
+            return 1;
+        }
+        std::vector<std::string> scripts;
+        for (const auto& argument : batchArguments) {
+            std::string error;
+            if (!BatchRunner::collect(argument, scripts, error)) {
+                std::cerr << error << "\n";
+                return 1;
+            }
+        }
+        uint64_t allocationsBefore = HeapStats::allocations();
+        uint64_t bytesBefore = HeapStats::bytesAllocated();
+        int status = BatchRunner(engine).run(scripts, OutputChannel::standard(), std::cerr);
+        if (stats)
+            printStats(allocationsBefore, bytesBefore);
+        return status;
+    }
+    if (!scriptPath) {
+        std::cerr << "Usage: " << argv[0] << " [--engine=parser|ast|vm] [--stats] [--memo=off|<entries>] [--jit=on|off] [--tier=off|<hotness>]\n"
+                  << "         [--overflow=wrap|trap] [--threads=<count>] [--trace=off|info|debug|verbose] [--trace-categories=lexer,parser,scopes,calls,loops|all]\n"
+                  << "         [--trace-echo] [--flush=auto|line|exit|<bytes>] [--output=<file>] [--stream | --engine=vm --cache | --dump-optimized] <script-file|->\n"
+                  << "       " << argv[0] << " --batch [--engine=parser|ast|vm] [options] <script-file|directory|@manifest>...\n"
+                  << "       " << argv[0] << " --repl\n"
+                  << "       " << argv[0] << " --bench=lexer|values|output|session|cache|jit|host [script-file]\n";
         return 1;
     }
-    std::ifstream file(argv[1]);
-    if (!file) {
-        std::cerr << "Failed to open file: " << argv[1] << "\n";
+    uint64_t allocationsBefore = HeapStats::allocations();
+    uint64_t bytesBefore = HeapStats::bytesAllocated();
+    const bool standardInput = std::string(scriptPath) == "-";
+    if (cache && (stream || engine != Engine::VM)) {
+        std::cerr << "--cache stores vm bytecode; use it with --engine=vm and without --stream\n";
         return 1;
     }
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(file, line)) {
-        if (!line.empty()) {
-            lines.push_back(line);
+    if (cache && standardInput) {
+        std::cerr << "--cache stores bytecode next to a script file; it cannot cache standard input\n";
+        return 1;
+    }
+    if (stream) {
+        if (engine != Engine::AST) {
+            std::cerr << "--stream runs scripts on the ast engine only\n";
+            return 1;
+        }
+        if (standardInput) {
+            execStream(std::cin);
+        } else {
+            std::ifstream file(scriptPath, std::ios::binary);
+            if (!file) {
+                std::cerr << "Failed to open file: " << scriptPath << "\n";
+                return 1;
+            }
+            execStream(file);
+        }
+    } else {
+        ScriptFile script;
+        if (standardInput ? !script.read(std::cin) : !script.open(scriptPath)) {
+            std::cerr << "Failed to open file: " << scriptPath << "\n";
+            return 1;
         }
+        if (dump)
+            dumpOptimized(script.text(), std::cout);
+        else if (cache)
+            execCached(script.text(), ProgramCache::pathFor(scriptPath));
+        else
+            execSource(script.text(), engine);
     }
-    execStatements(lines);
+    if (stats)
+        printStats(allocationsBefore, bytesBefore);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,77 @@
+#include "memo.h"
+#include <functional>
+#include <map>
+#include <mutex>
+static size_t configuredCapacity = MemoTable::DEFAULT_CAPACITY;
+struct MemoTotals {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+static std::mutex totalsMutex;
+static std::map<std::string, MemoTotals>& totals() {
+    static std::map<std::string, MemoTotals> byFunction;
+    return byFunction;
+}
+static uint64_t hashValue(const Value& value) {
+    if (value.isInt())
+        return static_cast<uint64_t>(value.asInt()) * 0x9E3779B97F4A7C15ull;
+    return std::hash<std::string_view>()(value.asString()) ^ 0x5555555555555555ull;
+}
+MemoKey::MemoKey(const Value* values, size_t count) : count(count), hash(count) {
+    for (size_t i = 0; i < count; ++i) {
+        args[i] = values[i];
+        hash = (hash ^ hashValue(values[i])) * 0x100000001B3ull;
+    }
+    hash ^= hash >> 31;
+}
+bool MemoKey::operator==(const MemoKey& other) const {
+    if (hash != other.hash || count != other.count)
+        return false;
+    for (size_t i = 0; i < count; ++i) {
+        if (args[i] != other.args[i])
+            return false;
+    }
+    return true;
+}
+MemoTable::MemoTable(std::string name) : name(std::move(name)) {}
+MemoTable::~MemoTable() {
+    if (hits == 0 && misses == 0)
+        return;
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    MemoTotals& total = totals()[name];
+    total.hits += hits;
+    total.misses += misses;
+}
+void MemoTable::setCapacity(size_t entries) {
+    size_t rounded = 1;
+    while (rounded < entries)
+        rounded <<= 1;
+    configuredCapacity = entries == 0 ? 0 : rounded;
+}
+size_t MemoTable::capacity() {
+    return configuredCapacity;
+}
+void MemoTable::report(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    for (const auto& [function, total] : totals())
+        out << "Memoized " << function << ": " << total.hits << " hits, " << total.misses << " misses\n";
+}
+const Value* MemoTable::find(const MemoKey& key) {
+    if (!entries.empty()) {
+        const Entry& entry = entries[key.hash & (entries.size() - 1)];
+        if (entry.used && entry.key == key) {
+            ++hits;
+            return &entry.result;
+        }
+    }
+    ++misses;
+    return nullptr;
+}
+void MemoTable::store(const MemoKey& key, const Value& result) {
+    if (entries.empty())
+        entries.resize(configuredCapacity);
+    Entry& entry = entries[key.hash & (entries.size() - 1)];
+    entry.key = key;
+    entry.result = result;
+    entry.used = true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "value.h"
+#include <array>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+// Argument values of one call to a memoized function.
+struct MemoKey {
+    static constexpr size_t MAX_ARGS = 4;
+    std::array<Value, MAX_ARGS> args;
+    size_t count = 0;
+    uint64_t hash = 0;
+    MemoKey() = default;
+    MemoKey(const Value* values, size_t count);
+    bool operator==(const MemoKey& other) const;
+};
+// Bounded result cache for one pure function (see
+// Resolver::markPureFunctions). Direct-mapped: a colliding call replaces
+// the older entry, so memory stays fixed however many distinct arguments
+// a script uses. Counters are added to the process-wide totals printed by
+// --stats when the table is destroyed.
+class MemoTable {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+    explicit MemoTable(std::string name);
+    ~MemoTable();
+    MemoTable(const MemoTable&) = delete;
+    MemoTable& operator=(const MemoTable&) = delete;
+    // Entries per function, rounded up to a power of two; 0 turns
+    // memoization off for the run.
+    static void setCapacity(size_t entries);
+    static size_t capacity();
+    static bool enabled() { return capacity() != 0; }
+    static bool eligible(size_t arity) { return enabled() && arity <= MemoKey::MAX_ARGS; }
+    static void report(std::ostream& out);
+    const Value* find(const MemoKey& key);
+    void store(const MemoKey& key, const Value& result);
+private:
+    struct Entry {
+        MemoKey key;
+        Value result;
+        bool used = false;
+    };
+    std::string name;
+    std::vector<Entry> entries;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
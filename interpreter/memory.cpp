@@ -0,0 +1,66 @@
+#include "memory.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+namespace {
+// One cache line per slot. Threads are handed slots in turn and only
+// share one beyond slotCount threads.
+struct alignas(64) Counters {
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<uint64_t> bytes{0};
+};
+constexpr size_t slotCount = 64;
+Counters slots[slotCount];
+std::atomic<size_t> nextSlot{0};
+thread_local Counters* ownSlot = nullptr;
+Counters& threadCounters() {
+    if (!ownSlot)
+        ownSlot = &slots[nextSlot.fetch_add(1, std::memory_order_relaxed) % slotCount];
+    return *ownSlot;
+}
+}
+uint64_t HeapStats::allocations() {
+    uint64_t total = 0;
+    for (const Counters& counters : slots)
+        total += counters.allocations.load(std::memory_order_relaxed);
+    return total;
+}
+uint64_t HeapStats::bytesAllocated() {
+    uint64_t total = 0;
+    for (const Counters& counters : slots)
+        total += counters.bytes.load(std::memory_order_relaxed);
+    return total;
+}
+static void* countedAllocate(size_t size) {
+    Counters& counters = threadCounters();
+    counters.allocations.fetch_add(1, std::memory_order_relaxed);
+    counters.bytes.fetch_add(size, std::memory_order_relaxed);
+    // Same contract as the standard operator new: keep calling the installed
+    // new-handler until malloc succeeds or no handler is left.
+    while (true) {
+        if (void* block = std::malloc(size ? size : 1))
+            return block;
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            throw std::bad_alloc();
+        handler();
+    }
+}
+void* operator new(size_t size) {
+    return countedAllocate(size);
+}
+void* operator new[](size_t size) {
+    return countedAllocate(size);
+}
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block) noexcept {
+    std::free(block);
+}
+void operator delete(void* block, size_t) noexcept {
+    std::free(block);
+}
+void operator delete[](void* block, size_t) noexcept {
+    std::free(block);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <cstdint>
+// Process-wide heap counters, fed by the replacement operator new/delete
+// in memory.cpp. Each thread counts into its own slot, so threads do not
+// contend on them; reads add the slots up.
+class HeapStats {
+public:
+    static uint64_t allocations();
+    static uint64_t bytesAllocated();
+};
@@ -0,0 +1,191 @@
+#include "optimizer.h"
+#include "arithmetic.h"
+#include <algorithm>
+#include <cstdint>
+Optimizer::Optimizer(Program& program) : program(program) {}
+void Optimizer::optimize() {
+    optimizeStatements(program.statements);
+    for (auto& [name, func] : program.functions)
+        optimizeFunction(*func);
+}
+void Optimizer::optimizeStatements(Block& statements) {
+    optimizeBlock(statements);
+}
+void Optimizer::optimizeFunction(FunctionDef& func) {
+    optimizeBlock(func.body);
+}
+static bool isNumber(const ExprPtr& expr) {
+    return expr->kind == Expr::NUMBER;
+}
+static bool isNumber(const ExprPtr& expr, int value) {
+    return expr->kind == Expr::NUMBER && expr->number == value;
+}
+static StmtPtr blockOf(size_t position, Block body) {
+    auto stmt = std::make_unique<Stmt>(Stmt{Stmt::BLOCK, position});
+    stmt->body = std::move(body);
+    return stmt;
+}
+// Wraps an operand whose arithmetic was removed so it still fails on a
+// string, unless it is already known to be an integer.
+static ExprPtr requireInt(ExprPtr operand, size_t position) {
+    if (operand->isInt)
+        return operand;
+    auto check = std::make_unique<Expr>(Expr{Expr::CHECK_INT, position});
+    check->left = std::move(operand);
+    check->isInt = true;
+    return check;
+}
+void Optimizer::optimizeBlock(Block& block) {
+    for (auto& stmt : block)
+        optimizeStmt(stmt);
+    block.erase(std::remove_if(block.begin(), block.end(),
+                               [](const StmtPtr& stmt) { return stmt->kind == Stmt::PASS; }),
+                block.end());
+}
+void Optimizer::optimizeStmt(StmtPtr& stmt) {
+    if (stmt->expr)
+        optimizeExpr(stmt->expr);
+    if (stmt->init)
+        optimizeStmt(stmt->init);
+    if (stmt->update)
+        optimizeStmt(stmt->update);
+    switch (stmt->kind) {
+        case Stmt::IF:
+            optimizeBlock(stmt->body);
+            optimizeBlock(stmt->elseBody);
+            if (isNumber(stmt->expr))
+                stmt = blockOf(stmt->position, std::move(stmt->expr->number ? stmt->body : stmt->elseBody));
+            break;
+        case Stmt::WHILE:
+            optimizeBlock(stmt->body);
+            if (isNumber(stmt->expr, 0))
+                stmt = std::make_unique<Stmt>(Stmt{Stmt::PASS, stmt->position});
+            break;
+        case Stmt::FOR:
+            optimizeBlock(stmt->body);
+            if (stmt->expr && isNumber(stmt->expr, 0)) {
+                Block init;
+                if (stmt->init)
+                    init.push_back(std::move(stmt->init));
+                stmt = blockOf(stmt->position, std::move(init));
+            }
+            break;
+        case Stmt::DO_WHILE:
+        case Stmt::BLOCK:
+            optimizeBlock(stmt->body);
+            break;
+        default:
+            break;
+    }
+    if (stmt->kind == Stmt::BLOCK && stmt->body.empty())
+        stmt->kind = Stmt::PASS;
+}
+void Optimizer::optimizeExpr(ExprPtr& expr) {
+    switch (expr->kind) {
+        case Expr::NUMBER:
+            expr->isInt = true;
+            return;
+        case Expr::STRING:
+        case Expr::VARIABLE:
+            return;
+        case Expr::CALL:
+            for (auto& arg : expr->args)
+                optimizeExpr(arg);
+            return;
+        case Expr::CHECK_INT:
+            optimizeExpr(expr->left);
+            if (expr->left->isInt)
+                expr = std::move(expr->left);
+            return;
+        case Expr::NEGATE:
+            optimizeExpr(expr->left);
+            expr->isInt = true;
+            int64_t value;
+            if (isNumber(expr->left) && Arithmetic::negate(expr->left->number, value)) {
+                expr = std::move(expr->left);
+                expr->number = value;
+            } else if (expr->left->kind == Expr::NEGATE) {
+                expr = requireInt(std::move(expr->left->left), expr->position);
+            }
+            return;
+        case Expr::BINARY:
+            optimizeExpr(expr->left);
+            optimizeExpr(expr->right);
+            expr->isInt = true;
+            foldBinary(expr);
+            if (expr->kind == Expr::BINARY)
+                simplifyIdentity(expr);
+            return;
+    }
+}
+void Optimizer::foldBinary(ExprPtr& expr) {
+    const Expr& left = *expr->left;
+    const Expr& right = *expr->right;
+    if ((expr->op == BinaryOp::EQUAL || expr->op == BinaryOp::NOT_EQUAL)
+        && (left.kind == Expr::STRING || right.kind == Expr::STRING)
+        && (left.kind == Expr::STRING || left.kind == Expr::NUMBER)
+        && (right.kind == Expr::STRING || right.kind == Expr::NUMBER)) {
+        // Literals are interned, so equal text means equal symbols.
+        bool equal = left.kind == right.kind && left.symbol == right.symbol;
+        expr->kind = Expr::NUMBER;
+        expr->number = (expr->op == BinaryOp::EQUAL) == equal ? 1 : 0;
+        expr->left.reset();
+        expr->right.reset();
+        return;
+    }
+    if (left.kind != Expr::NUMBER || right.kind != Expr::NUMBER)
+        return;
+    int64_t a = left.number, b = right.number, result = 0;
+    bool exact = true;
+    switch (expr->op) {
+        case BinaryOp::ADD: exact = Arithmetic::add(a, b, result); break;
+        case BinaryOp::SUB: exact = Arithmetic::subtract(a, b, result); break;
+        case BinaryOp::MUL: exact = Arithmetic::multiply(a, b, result); break;
+        case BinaryOp::DIV:
+            if (b == 0)
+                return;
+            exact = Arithmetic::divide(a, b, result);
+            break;
+        case BinaryOp::EQUAL: result = a == b; break;
+        case BinaryOp::NOT_EQUAL: result = a != b; break;
+        case BinaryOp::LESS: result = a < b; break;
+        case BinaryOp::LESS_EQUAL: result = a <= b; break;
+        case BinaryOp::GREATER: result = a > b; break;
+        case BinaryOp::GREATER_EQUAL: result = a >= b; break;
+    }
+    // What overflows wraps or traps depending on --overflow, so it is left
+    // to run.
+    if (!exact)
+        return;
+    expr->kind = Expr::NUMBER;
+    expr->number = result;
+    expr->left.reset();
+    expr->right.reset();
+}
+void Optimizer::simplifyIdentity(ExprPtr& expr) {
+    size_t position = expr->position;
+    switch (expr->op) {
+        case BinaryOp::ADD:
+            if (isNumber(expr->right, 0))
+                expr = requireInt(std::move(expr->left), position);
+            else if (isNumber(expr->left, 0))
+                expr = requireInt(std::move(expr->right), position);
+            break;
+        case BinaryOp::SUB:
+            if (isNumber(expr->right, 0))
+                expr = requireInt(std::move(expr->left), position);
+            break;
+        case BinaryOp::MUL:
+            if (isNumber(expr->right, 1))
+                expr = requireInt(std::move(expr->left), position);
+            else if (isNumber(expr->left, 1))
+                expr = requireInt(std::move(expr->right), position);
+            break;
+        case BinaryOp::DIV:
+            if (isNumber(expr->right, 1))
+                expr = requireInt(std::move(expr->left), position);
+            break;
+        default:
+            break;
+    }
+}
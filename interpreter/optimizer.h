@@ -0,0 +1,22 @@
+#pragma once
+#include "ast.h"
+// AST-to-AST simplification run between parsing and resolution. Folds
+// constant arithmetic and comparisons, drops identity operations, and
+// replaces if/while/for statements whose conditions are constant by the
+// code that would actually run. Every rewrite keeps the program's
+// behaviour, including the "expected an integer" errors an operation
+// would have raised, and leaves overflowing arithmetic to run time.
+class Optimizer {
+public:
+    Optimizer(Program& program);
+    void optimize();
+    void optimizeStatements(Block& statements);
+    void optimizeFunction(FunctionDef& func);
+private:
+    Program& program;
+    void optimizeBlock(Block& block);
+    void optimizeStmt(StmtPtr& stmt);
+    void optimizeExpr(ExprPtr& expr);
+    void foldBinary(ExprPtr& expr);
+    void simplifyIdentity(ExprPtr& expr);
+};
@@ -0,0 +1,117 @@
+#include "output.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#ifdef _WIN32
+#include <io.h>
+#define PDEV_WRITE _write
+#define PDEV_CLOSE _close
+#define PDEV_ISATTY _isatty
+#define PDEV_OPEN_FLAGS (_O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY)
+#else
+#include <unistd.h>
+#define PDEV_WRITE ::write
+#define PDEV_CLOSE ::close
+#define PDEV_ISATTY ::isatty
+#define PDEV_OPEN_FLAGS (O_WRONLY | O_CREAT | O_TRUNC)
+#endif
+OutputChannel::OutputChannel(int fd, Flush policy, size_t threshold)
+    : fd(fd), buffer(new char[BUFFER_SIZE]) {
+    setPolicy(policy, threshold);
+}
+OutputChannel::OutputChannel(std::string& sink) : sink(&sink) {}
+OutputChannel::~OutputChannel() {
+    flush();
+    if (ownsFd)
+        PDEV_CLOSE(fd);
+}
+OutputChannel& OutputChannel::standard() {
+    static OutputChannel channel(1);
+    return channel;
+}
+bool OutputChannel::parsePolicy(const std::string& name, Flush& policy, size_t& threshold) {
+    threshold = BUFFER_SIZE;
+    if (name == "auto") policy = Flush::AUTO;
+    else if (name == "line") policy = Flush::LINE;
+    else if (name == "exit") policy = Flush::EXIT;
+    else if (!name.empty() && std::all_of(name.begin(), name.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        policy = Flush::BYTES;
+        threshold = std::stoul(name);
+    } else {
+        return false;
+    }
+    return true;
+}
+void OutputChannel::setPolicy(Flush newPolicy, size_t newThreshold) {
+    if (newPolicy == Flush::AUTO)
+        newPolicy = fd >= 0 && PDEV_ISATTY(fd) ? Flush::LINE : Flush::EXIT;
+    policy = newPolicy;
+    threshold = std::clamp<size_t>(newThreshold, 1, BUFFER_SIZE);
+}
+bool OutputChannel::redirect(const std::string& path) {
+#ifdef _WIN32
+    int target = _open(path.c_str(), PDEV_OPEN_FLAGS, 0644);
+#else
+    int target = ::open(path.c_str(), PDEV_OPEN_FLAGS, 0644);
+#endif
+    if (target < 0)
+        return false;
+    flush();
+    if (ownsFd)
+        PDEV_CLOSE(fd);
+    fd = target;
+    ownsFd = true;
+    return true;
+}
+void OutputChannel::writeFd(const char* data, size_t size) {
+    while (size > 0) {
+        auto written = PDEV_WRITE(fd, data, static_cast<unsigned>(std::min<size_t>(size, 1u << 30)));
+        if (written <= 0)
+            return;
+        data += written;
+        size -= written;
+    }
+}
+void OutputChannel::flush() {
+    if (used == 0)
+        return;
+    writeFd(buffer.get(), used);
+    used = 0;
+}
+void OutputChannel::write(std::string_view text) {
+    if (sink) {
+        sink->append(text);
+        return;
+    }
+    if (used + text.size() > BUFFER_SIZE) {
+        flush();
+        if (text.size() >= BUFFER_SIZE) {
+            writeFd(text.data(), text.size());
+            return;
+        }
+    }
+    std::memcpy(buffer.get() + used, text.data(), text.size());
+    used += text.size();
+}
+void OutputChannel::write(int64_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    write(std::string_view(digits, result.ptr - digits));
+}
+void OutputChannel::endLine() {
+    write(std::string_view("\n", 1));
+    if (policy == Flush::LINE || (policy == Flush::BYTES && used >= threshold))
+        flush();
+}
+void OutputChannel::writeLine(std::string_view text) {
+    write(text);
+    endLine();
+}
+void OutputChannel::writeLine(const Value& value) {
+    if (value.isInt())
+        write(value.asInt());
+    else
+        write(value.asString());
+    endLine();
+}
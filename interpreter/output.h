@@ -0,0 +1,44 @@
+#pragma once
+#include "value.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+// Buffered sink for write(). Output collects in a user-space buffer and
+// reaches the file descriptor in large chunks according to the flush
+// policy; flush() can always be called explicitly by a host. A channel
+// constructed over a std::string appends to it directly instead.
+class OutputChannel {
+public:
+    enum class Flush : uint8_t {
+        AUTO,   // LINE when the descriptor is a terminal, otherwise EXIT
+        LINE,   // after every completed line
+        BYTES,  // once the pending output reaches the threshold
+        EXIT    // only when the buffer fills and when the channel closes
+    };
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+    explicit OutputChannel(int fd, Flush policy = Flush::AUTO, size_t threshold = BUFFER_SIZE);
+    explicit OutputChannel(std::string& sink);
+    OutputChannel(const OutputChannel&) = delete;
+    OutputChannel& operator=(const OutputChannel&) = delete;
+    ~OutputChannel();
+    static OutputChannel& standard();
+    static bool parsePolicy(const std::string& name, Flush& policy, size_t& threshold);
+    void setPolicy(Flush policy, size_t threshold = BUFFER_SIZE);
+    bool redirect(const std::string& path);
+    void write(std::string_view text);
+    void write(int64_t value);
+    void writeLine(std::string_view text);
+    void writeLine(const Value& value);
+    void flush();
+private:
+    int fd = -1;
+    bool ownsFd = false;
+    std::string* sink = nullptr;
+    Flush policy = Flush::EXIT;
+    size_t threshold = BUFFER_SIZE;
+    size_t used = 0;
+    std::unique_ptr<char[]> buffer;
+    void endLine();
+    void writeFd(const char* data, size_t size);
+};
@@ -0,0 +1,116 @@
+#include "parallel.h"
+#include "arithmetic.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+bool ParallelFor::iterations(Until until, int64_t start, int64_t bound, int64_t step, uint64_t& count) {
+    count = 0;
+    const bool upward = step > 0;
+    const uint64_t stride = upward ? static_cast<uint64_t>(step) : 0 - static_cast<uint64_t>(step);
+    const uint64_t distance = upward ? static_cast<uint64_t>(bound) - static_cast<uint64_t>(start)
+                                     : static_cast<uint64_t>(start) - static_cast<uint64_t>(bound);
+    switch (until) {
+        case Until::LESS:
+        case Until::GREATER:
+            if (until == Until::LESS ? start >= bound : start <= bound)
+                return true;
+            if (upward != (until == Until::LESS))
+                return false;
+            count = distance / stride + (distance % stride != 0);
+            break;
+        case Until::LESS_EQUAL:
+        case Until::GREATER_EQUAL:
+            if (until == Until::LESS_EQUAL ? start > bound : start < bound)
+                return true;
+            if (upward != (until == Until::LESS_EQUAL))
+                return false;
+            count = distance / stride + 1;
+            break;
+        case Until::NOT_EQUAL:
+            if (start == bound)
+                return true;
+            if (distance % stride != 0)
+                return false;
+            count = distance / stride;
+            break;
+    }
+    int64_t span, end;
+    return count != 0 && count <= static_cast<uint64_t>(INT64_MAX)
+        && Arithmetic::multiply(static_cast<int64_t>(count), step, span) && Arithmetic::add(start, span, end);
+}
+bool ParallelFor::combine(Reduce op, int64_t value, int64_t partial, int64_t& result) {
+    return op == Reduce::ADD ? Arithmetic::add(value, partial, result) : Arithmetic::multiply(value, partial, result);
+}
+ParallelFor::ParallelFor(OutputChannel& output, bool unordered, std::vector<Reduce> reductions)
+    : target(output), unordered(unordered), reductions(std::move(reductions)) {
+    size_t count = workers();
+    for (size_t i = 0; i < count; ++i) {
+        sinks.push_back(std::make_unique<std::string>());
+        channels.push_back(std::make_unique<OutputChannel>(*sinks.back()));
+    }
+}
+ParallelFor::~ParallelFor() = default;
+size_t ParallelFor::workers() const {
+    return ThreadPool::shared().workers();
+}
+OutputChannel& ParallelFor::output(size_t worker) {
+    return *channels[worker];
+}
+void ParallelFor::run(int64_t start, int64_t step, uint64_t count, const Chunk& chunk) {
+    totals.assign(reductions.size(), 0);
+    for (size_t r = 0; r < reductions.size(); ++r)
+        totals[r] = identity(reductions[r]);
+    exactTotals.assign(reductions.size(), 1);
+    if (count == 0)
+        return;
+    enum State : uint8_t { PENDING, DONE, FAILED };
+    const size_t chunks = static_cast<size_t>(std::min<uint64_t>(count, workers() * CHUNKS_PER_WORKER));
+    const uint64_t base = count / chunks;
+    const uint64_t extra = count % chunks;
+    const size_t width = reductions.size();
+    std::vector<std::string> texts(chunks);
+    std::vector<State> states(chunks, PENDING);
+    std::vector<std::exception_ptr> errors(chunks);
+    std::vector<int64_t> partials(chunks * width);
+    std::atomic<size_t> firstFailure{chunks};
+    std::mutex outputLock;
+    size_t nextOutput = 0;
+    ThreadPool::shared().run(chunks, [&](size_t index, size_t worker) {
+        if (index > firstFailure)
+            return;
+        uint64_t offset = index * base + std::min<uint64_t>(index, extra);
+        uint64_t length = base + (index < extra ? 1 : 0);
+        int64_t first = static_cast<int64_t>(static_cast<uint64_t>(start) + offset * static_cast<uint64_t>(step));
+        bool failed = false;
+        try {
+            chunk(worker, first, length, partials.data() + index * width);
+        } catch (...) {
+            errors[index] = std::current_exception();
+            failed = true;
+            size_t seen = firstFailure;
+            while (index < seen && !firstFailure.compare_exchange_weak(seen, index)) {}
+        }
+        std::lock_guard<std::mutex> guard(outputLock);
+        texts[index] = std::move(*sinks[worker]);
+        sinks[worker]->clear();
+        states[index] = failed ? FAILED : DONE;
+        if (unordered) {
+            target.write(texts[index]);
+            std::string().swap(texts[index]);
+            return;
+        }
+        while (nextOutput < chunks && states[nextOutput] != PENDING) {
+            target.write(texts[nextOutput]);
+            std::string().swap(texts[nextOutput]);
+            nextOutput = states[nextOutput] == FAILED ? chunks : nextOutput + 1;
+        }
+    });
+    if (firstFailure < chunks)
+        std::rethrow_exception(errors[firstFailure]);
+    for (size_t index = 0; index < chunks; ++index) {
+        for (size_t r = 0; r < width; ++r)
+            exactTotals[r] &= combine(reductions[r], totals[r], partials[index * width + r], totals[r]) ? 1 : 0;
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "output.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+// Runs the iterations of a `parallel for` on the shared ThreadPool. The
+// range is cut into chunks of consecutive iterations, and each thread runs
+// its chunks on an engine of its own, over copies of the variables. What a
+// chunk writes reaches the loop's output in iteration order, or in the
+// order chunks finish when the loop is unordered. Each chunk leaves one
+// partial result per reduction; partials are combined in chunk order, so
+// results never depend on the schedule. An error stops the chunks after
+// the failing one and is rethrown once the others finish; ordered output
+// then ends where the error happened, as it would in a plain loop.
+class ParallelFor {
+public:
+    // How the loop compares its counter with the bound.
+    enum class Until : uint8_t { LESS, LESS_EQUAL, GREATER, GREATER_EQUAL, NOT_EQUAL };
+    enum class Reduce : uint8_t { ADD, MULTIPLY };
+    // Chunks per worker thread, so threads that finish early can steal.
+    static constexpr size_t CHUNKS_PER_WORKER = 8;
+    // Runs `count` iterations from `first` on the engine of `worker`,
+    // leaving each reduction's partial result in `partials`.
+    using Chunk = std::function<void(size_t worker, int64_t first, uint64_t count, int64_t* partials)>;
+    // Iterations from `start` in steps of `step` while the counter is
+    // `until` the bound; false when the counter would wrap around first.
+    static bool iterations(Until until, int64_t start, int64_t bound, int64_t step, uint64_t& count);
+    static int64_t identity(Reduce op) { return op == Reduce::ADD ? 0 : 1; }
+    // False when the exact result does not fit; `result` wraps either way.
+    static bool combine(Reduce op, int64_t value, int64_t partial, int64_t& result);
+    ParallelFor(OutputChannel& output, bool unordered, std::vector<Reduce> reductions);
+    ~ParallelFor();
+    size_t workers() const;
+    // For the engine on `worker`; a chunk's writes are taken from it when
+    // the chunk ends.
+    OutputChannel& output(size_t worker);
+    void run(int64_t start, int64_t step, uint64_t count, const Chunk& chunk);
+    // The combined partials, one per reduction; exact(r) is false when
+    // combining those of reduction r overflowed.
+    const std::vector<int64_t>& results() const { return totals; }
+    bool exact(size_t reduction) const { return exactTotals[reduction] != 0; }
+private:
+    OutputChannel& target;
+    bool unordered;
+    std::vector<Reduce> reductions;
+    std::vector<std::unique_ptr<std::string>> sinks;
+    std::vector<std::unique_ptr<OutputChannel>> channels;
+    std::vector<int64_t> totals;
+    std::vector<uint8_t> exactTotals;
+};
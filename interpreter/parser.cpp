@@ -1,57 +1,61 @@
 #include "parser.h"
 #include "Debugger.h"
 #include "ErrorHandler.h"
-#include <iostream>
-Parser::Parser(Lexer lexer) : lexer(lexer) {
+#include "arithmetic.h"
+Parser::Parser(Lexer& lexer, OutputChannel& output) : lexer(lexer), output(output) {
+    pushScope();
     currentToken = this->lexer.nextToken();
 }
 void Parser::consume(Token::Type expected) {
     if (currentToken.type == expected)
         currentToken = lexer.nextToken();
     else
-        ErrorHandler::throwError("Expected token type " + std::to_string(expected) + " but found '" + currentToken.text + "'", lexer.getLineNumber(lexer.getPosition()));
+        ErrorHandler::throwError("Expected token type " + std::to_string(expected) + " but found '" + std::string(lexer.text(currentToken)) + "'", lexer.getLocation(currentToken.position));
 }
 void Parser::pushScope() {
-    variableStack.emplace_back();
+    variableStack.push();
 }
 void Parser::popScope() {
     if (!variableStack.empty()) {
-        variableStack.pop_back();
+        variableStack.pop();
     } else {
-        ErrorHandler::throwError("Variable scope stack underflow", lexer.getLineNumber(lexer.getPosition()));
+        ErrorHandler::throwError("Variable scope stack underflow", lexer.getLocation(currentToken.position));
     }
 }
-Value Parser::lookupVariableValue(const std::string& name) {
-    for (auto it = variableStack.rbegin(); it != variableStack.rend(); ++it) {
-        auto found = it->find(name);
-        if (found != it->end()) {
-            return found->second;
-        }
-    }
-    ErrorHandler::throwError("Undefined variable: " + name, lexer.getLineNumber(lexer.getPosition()));
+Value Parser::lookupVariableValue(Symbol name) {
+    if (Value* found = variableStack.find(name))
+        return *found;
+    ErrorHandler::throwError("Undefined variable: " + SymbolTable::name(name), lexer.getLocation(currentToken.position));
     return Value(); 
 }
-void Parser::setVariableValue(const std::string& name, Value value) {
+void Parser::setVariableValue(Symbol name, Value value) {
     if (variableStack.empty()) {
-        ErrorHandler::throwError("No variable scope available", lexer.getLineNumber(lexer.getPosition()));
+        ErrorHandler::throwError("No variable scope available", lexer.getLocation(currentToken.position));
     }
-    variableStack.back()[name] = value;
+    variableStack.set(name, std::move(value));
+}
+// Wrapped results pass through unless overflow trapping is on.
+int64_t Parser::arithmetic(bool exact, int64_t result) {
+    if (!exact && Arithmetic::trapOverflow())
+        ErrorHandler::throwError("Integer overflow", lexer.getLocation(currentToken.position));
+    return result;
 }
-int Parser::expr() {
-    int result = term();
-    while (currentToken.type == Token::OP && (currentToken.text == "+" || currentToken.text == "-")) {
-        std::string op = currentToken.text;
+int64_t Parser::expr() {
+    int64_t result = term();
+    while (currentToken.type == Token::OP && (lexer.text(currentToken)[0] == '+' || lexer.text(currentToken)[0] == '-')) {
+        char op = lexer.text(currentToken)[0];
         consume(Token::OP);
-        int rhs = term();
-        result = (op == "+") ? result + rhs : result - rhs;
+        int64_t rhs = term();
+        bool exact = op == '+' ? Arithmetic::add(result, rhs, result) : Arithmetic::subtract(result, rhs, result);
+        result = arithmetic(exact, result);
     }
     return result;
 }
 void Parser::statement() {
-    Debugger::log("Entering statement() with token: " + currentToken.text + ", Type: " + std::to_string(currentToken.type));
+    PDEV_TRACE(VERBOSE, TRACE_PARSER, "Entering statement() with token: " + std::string(lexer.text(currentToken)) + ", Type: " + std::to_string(currentToken.type));
     switch (currentToken.type) {
         case Token::END:
-            Debugger::log("Reached END token in statement()");
+            PDEV_TRACE(VERBOSE, TRACE_PARSER, "Reached END token in statement()");
             return;
             case Token::FOR:
             parseForStatement();
@@ -60,13 +64,13 @@ void Parser::statement() {
             parseDoStatement();
             break;
         case Token::BREAK:
-            Debugger::log("Processing break statement");
+            PDEV_TRACE(DEBUG, TRACE_LOOPS, "Processing break statement");
             consume(Token::BREAK);
             consume(Token::SEMICOLON);
             loopBreak = true;
             break;
         case Token::CONTINUE:
-            Debugger::log("Processing continue statement");
+            PDEV_TRACE(DEBUG, TRACE_LOOPS, "Processing continue statement");
             consume(Token::CONTINUE);
             consume(Token::SEMICOLON);
             loopContinue = true;
@@ -75,7 +79,7 @@ void Parser::statement() {
             parseWhileStatement();
             break;
         case Token::PASS:
-            Debugger::log("Processing pass statement");
+            PDEV_TRACE(DEBUG, TRACE_PARSER, "Processing pass statement");
             consume(Token::PASS);
             consume(Token::SEMICOLON);
             break;
@@ -95,15 +99,15 @@ void Parser::statement() {
             parseReturnStatement();
             break;
         default:
-            ErrorHandler::throwError("Unknown statement starting with token: " + currentToken.text, lexer.getLineNumber(lexer.getPosition()));
+            ErrorHandler::throwError("Unknown statement starting with token: " + std::string(lexer.text(currentToken)), lexer.getLocation(currentToken.position));
     }
 }
 bool Parser::parseCondition() {
-    int left = expr();
+    int64_t left = expr();
     if (currentToken.type == Token::EQUAL || currentToken.type == Token::NOT_EQUAL || currentToken.type == Token::LESS || currentToken.type == Token::LESS_EQUAL || currentToken.type == Token::GREATER || currentToken.type == Token::GREATER_EQUAL) {
         Token op = currentToken;
         consume(op.type);
-        int right = expr();
+        int64_t right = expr();
         switch (op.type) {
             case Token::EQUAL: return left == right;
             case Token::NOT_EQUAL: return left != right;
@@ -111,39 +115,45 @@ bool Parser::parseCondition() {
             case Token::LESS_EQUAL: return left <= right;
             case Token::GREATER: return left > right;
             case Token::GREATER_EQUAL: return left >= right;
-            default: ErrorHandler::throwError("Invalid comparison operator in condition", lexer.getLineNumber(lexer.getPosition())); return false;
+            default: ErrorHandler::throwError("Invalid comparison operator in condition", lexer.getLocation(currentToken.position)); return false;
         }
     } else {
         return left != 0;
     }
 }
-int Parser::term() {
-    int result = factor();
-    while (currentToken.type == Token::OP && (currentToken.text == "*" || currentToken.text == "/")) {
-        std::string op = currentToken.text;
+int64_t Parser::term() {
+    int64_t result = factor();
+    while (currentToken.type == Token::OP && (lexer.text(currentToken)[0] == '*' || lexer.text(currentToken)[0] == '/')) {
+        char op = lexer.text(currentToken)[0];
         consume(Token::OP);
-        int rhs = factor();
-        if (op == "*") result *= rhs;
+        int64_t rhs = factor();
+        bool exact;
+        if (op == '*') exact = Arithmetic::multiply(result, rhs, result);
         else {
-            if (rhs == 0) ErrorHandler::throwError("Division by zero", lexer.getLineNumber(lexer.getPosition()));
-            result /= rhs;
+            if (rhs == 0) ErrorHandler::throwError("Division by zero", lexer.getLocation(currentToken.position));
+            exact = Arithmetic::divide(result, rhs, result);
         }
+        result = arithmetic(exact, result);
     }
     return result;
 }
-int Parser::factor() {
+int64_t Parser::factor() {
     if (currentToken.type == Token::LPAREN) {
         consume(Token::LPAREN);
-        int val = expr();
+        int64_t val = expr();
         consume(Token::RPAREN);
         return val;
     } else if (currentToken.type == Token::NUM) {
-        int val = std::stoi(currentToken.text);
-        Debugger::log(currentToken.text);
+        int64_t val = lexer.number(currentToken);
+        PDEV_TRACE(VERBOSE, TRACE_LEXER, "Numeric literal " + std::string(lexer.text(currentToken)));
         consume(Token::NUM);
         return val;
+    } else if (currentToken.type == Token::TRUE || currentToken.type == Token::FALSE) {
+        int val = currentToken.type == Token::TRUE ? 1 : 0;
+        consume(currentToken.type);
+        return val;
     } else if (currentToken.type == Token::VAR) {
-        std::string name = currentToken.text;
+        Symbol name = currentToken.symbol;
         Token nextToken = lexer.peekToken();
         if (nextToken.type == Token::LPAREN) {
             consume(Token::VAR);
@@ -151,18 +161,20 @@ int Parser::factor() {
         } else {
             consume(Token::VAR);
             Value val = lookupVariableValue(name);
-            if (std::holds_alternative<int>(val)) {
-                return std::get<int>(val);
+            if (val.isInt()) {
+                return val.asInt();
             } else {
-                ErrorHandler::throwError("Variable is not an integer: " + name, lexer.getLineNumber(lexer.getPosition()));
+                ErrorHandler::throwError("Variable is not an integer: " + SymbolTable::name(name), lexer.getLocation(currentToken.position));
                 return 0;
             }
         }
-    } else if (currentToken.type == Token::OP && currentToken.text == "-") {
+    } else if (currentToken.type == Token::OP && lexer.text(currentToken) == "-") {
         consume(Token::OP);
-        return -factor();
+        int64_t result;
+        bool exact = Arithmetic::negate(factor(), result);
+        return arithmetic(exact, result);
     } else {
-        ErrorHandler::throwError("Unexpected token in factor: " + currentToken.text, lexer.getLineNumber(lexer.getPosition()));
+        ErrorHandler::throwError("Unexpected token in factor: " + std::string(lexer.text(currentToken)), lexer.getLocation(currentToken.position));
         return 0;
     }
 }
@@ -194,8 +206,7 @@ void Parser::executeBlock() {
     popScope();
 }
 void Parser::parseAssignmentExpression() {
-    std::string varName = currentToken.text;
-    std::cout<<currentToken.text;
+    Symbol varName = currentToken.symbol;
     consume(Token::VAR);
     consume(Token::ARROW); 
     Value val = expr();
@@ -203,48 +214,48 @@ void Parser::parseAssignmentExpression() {
 }
 Parser::ForUpdateInfo Parser::parseForUpdateExpression() {
     ForUpdateInfo info;
-    info.varName = currentToken.text;
+    info.varName = currentToken.symbol;
     consume(Token::VAR);
-    if (currentToken.text == "++") {
+    if (lexer.text(currentToken) == "++") {
         consume(Token::INCREMENT);
         info.op = UpdateOp::INCREMENT;
-    } else if (currentToken.text == "--") {
+    } else if (lexer.text(currentToken) == "--") {
         consume(Token::DECREMENT);
         info.op = UpdateOp::DECREMENT;
     } else if (currentToken.type == Token::ARROW) {
         consume(Token::ARROW);
-        int value = expr();
+        int64_t value = expr();
         info.op = UpdateOp::ASSIGN;
         info.assignedValue = value;
         info.hasAssignedValue = true;
     } else {
-        ErrorHandler::throwError("Invalid update expression in for loop", lexer.getLineNumber(lexer.getPosition()));
+        ErrorHandler::throwError("Invalid update expression in for loop", lexer.getLocation(currentToken.position));
     }
     return info;
 }
 void Parser::parseForStatement() {
-    Debugger::log("Parsing for loop");
+    PDEV_TRACE(DEBUG, TRACE_LOOPS, "Parsing for loop");
     consume(Token::FOR);
     consume(Token::LPAREN);
 
-    Debugger::log("Entering new scope for for loop");
+    PDEV_TRACE(VERBOSE, TRACE_SCOPES, "Entering new scope for for loop");
     pushScope();
 
     if (currentToken.type != Token::SEMICOLON) {
-        Debugger::log("Parsing initialization/assignment part of for loop");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Parsing initialization/assignment part of for loop");
         parseAssignmentExpression();
     }
     size_t conditionPos = lexer.getPosition();
     consume(Token::SEMICOLON);
 
-    Debugger::log("Saving position for condition expression");
+    PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Saving position for condition expression");
     
     bool condition = true;
 
     if (currentToken.type != Token::SEMICOLON) {
-        Debugger::log("Parsing condition of for loop");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Parsing condition of for loop");
         condition = parseCondition();
-        Debugger::log("Initial condition evaluated to: " + std::string(condition ? "true" : "false"));
+        PDEV_TRACE(DEBUG, TRACE_LOOPS, "Initial condition evaluated to: " + std::string(condition ? "true" : "false"));
     }
     consume(Token::SEMICOLON);
 
@@ -253,9 +264,9 @@ void Parser::parseForStatement() {
     ForUpdateInfo updateInfo;
 
     if (hasUpdate) {
-        Debugger::log("Parsing update expression of for loop");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Parsing update expression of for loop");
         updateInfo = parseForUpdateExpression();
-        Debugger::log("Parsed update: var = " + updateInfo.varName);
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Parsed update: var = " + SymbolTable::name(updateInfo.varName));
     }
 
     consume(Token::RPAREN);
@@ -264,74 +275,86 @@ void Parser::parseForStatement() {
     Token savedToken = currentToken;
 
     while (condition && !hasReturnValue) {
-        Debugger::log("For loop iteration start");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "For loop iteration start");
         loopBreak = false;
         loopContinue = false;
 
         lexer.setPosition(blockStart);
         currentToken = savedToken;
 
-        Debugger::log("Executing for loop block");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Executing for loop block");
         executeBlock();
 
         if (loopBreak) {
-            Debugger::log("Loop break encountered");
+            PDEV_TRACE(DEBUG, TRACE_LOOPS, "Loop break encountered");
             break;
         }
         if (hasReturnValue) {
-            Debugger::log("Return encountered inside for loop");
+            PDEV_TRACE(DEBUG, TRACE_LOOPS, "Return encountered inside for loop");
             break;
         }
 
         if (hasUpdate) {
-            Debugger::log("Applying update expression");
+            PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Applying update expression");
             Value oldVal = lookupVariableValue(updateInfo.varName);
 
             switch (updateInfo.op) {
                 case UpdateOp::INCREMENT:
-                    if (!std::holds_alternative<int>(oldVal))
-                        ErrorHandler::throwError("Cannot increment non-integer variable: " + updateInfo.varName);
-                    setVariableValue(updateInfo.varName, Value(std::get<int>(oldVal) + 1));
+                    if (!oldVal.isInt())
+                        ErrorHandler::throwError("Cannot increment non-integer variable: " + SymbolTable::name(updateInfo.varName), lexer.getLocation(currentToken.position));
+                    {
+                        int64_t result;
+                        bool exact = Arithmetic::add(oldVal.asInt(), 1, result);
+                        setVariableValue(updateInfo.varName, Value(arithmetic(exact, result)));
+                    }
                     lookupVariableValue(updateInfo.varName);
-                    Debugger::log("Incremented variable " + updateInfo.varName);
+                    PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Incremented variable " + SymbolTable::name(updateInfo.varName));
                     break;
 
                 case UpdateOp::DECREMENT:
-                    if (!std::holds_alternative<int>(oldVal))
-                        ErrorHandler::throwError("Cannot decrement non-integer variable: " + updateInfo.varName);
-                    setVariableValue(updateInfo.varName, Value(std::get<int>(oldVal) - 1));
-                    Debugger::log("Decremented variable " + updateInfo.varName);
+                    if (!oldVal.isInt())
+                        ErrorHandler::throwError("Cannot decrement non-integer variable: " + SymbolTable::name(updateInfo.varName), lexer.getLocation(currentToken.position));
+                    {
+                        int64_t result;
+                        bool exact = Arithmetic::subtract(oldVal.asInt(), 1, result);
+                        setVariableValue(updateInfo.varName, Value(arithmetic(exact, result)));
+                    }
+                    PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Decremented variable " + SymbolTable::name(updateInfo.varName));
                     break;
 
-                case UpdateOp::ASSIGN:
-                    if (updateInfo.hasAssignedValue) {
-                        setVariableValue(updateInfo.varName, updateInfo.assignedValue);
-                        Debugger::log("Assigned value to variable " + updateInfo.varName);
-                    } else {
-                        ErrorHandler::throwError("No value for assignment update in for loop");
-                    }
+                case UpdateOp::ASSIGN: {
+                    // The right-hand side depends on the loop state, so it is
+                    // re-read from the update clause on every iteration.
+                    lexer.setPosition(updatePos - 1);
+                    currentToken = lexer.nextToken();
+                    ForUpdateInfo current = parseForUpdateExpression();
+                    setVariableValue(updateInfo.varName, current.assignedValue);
+                    PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Assigned value to variable " + SymbolTable::name(updateInfo.varName));
                     break;
+                }
 
                 default:
-                    Debugger::log("No update operation");
+                    PDEV_TRACE(VERBOSE, TRACE_LOOPS, "No update operation");
                     break;
             }
         }
 
-        Debugger::log("Re-evaluating for loop condition");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Re-evaluating for loop condition");
         lexer.setPosition(conditionPos);
-        currentToken = lexer.peekToken();
+        currentToken = lexer.nextToken();
+#if PDEV_TRACE_ENABLED
         Debugger::printContextTokens(lexer);
+#endif
         condition = parseCondition();
         
-        Debugger::log("Condition result: " + std::string(condition ? "true" : "false"));
+        PDEV_TRACE(DEBUG, TRACE_LOOPS, "Condition result: " + std::string(condition ? "true" : "false"));
     }
 
-    Debugger::log("Popping for loop scope");
+    PDEV_TRACE(VERBOSE, TRACE_SCOPES, "Popping for loop scope");
     popScope();
 
     if (!condition || hasReturnValue) {
-        Debugger::log("Skipping remaining for loop block");
+        PDEV_TRACE(VERBOSE, TRACE_LOOPS, "Skipping remaining for loop block");
         lexer.setPosition(blockStart);
         currentToken = savedToken;
         skipBlock();
@@ -438,86 +461,90 @@ void Parser::parseIfStatement() {
     }
 }
 void Parser::parseVarOrFunctionCall() {
-    std::string name = currentToken.text;
+    Symbol name = currentToken.symbol;
     Token nextToken = lexer.peekToken();
     if (nextToken.type == Token::ARROW) {
-        Debugger::log("Detected variable assignment to " + name);
+        PDEV_TRACE(DEBUG, TRACE_PARSER, "Detected variable assignment to " + SymbolTable::name(name));
         consume(Token::VAR);
         consume(Token::ARROW);
         if (currentToken.type == Token::STRING) {
-            setVariableValue(name, currentToken.text);
+            setVariableValue(name, SymbolTable::string(currentToken.symbol));
             consume(Token::STRING);
         } else {
-            int value = expr(); 
+            int64_t value = expr(); 
             setVariableValue(name, value);
         }
         consume(Token::SEMICOLON);
     }
     else if (nextToken.type == Token::LPAREN) {
-        Debugger::log("Detected function call to " + name);
+        PDEV_TRACE(DEBUG, TRACE_CALLS, "Detected function call to " + SymbolTable::name(name));
         consume(Token::VAR);
         parseFunctionCallArgsAndExecute(name);
         consume(Token::SEMICOLON);
     }
     else {
-        ErrorHandler::throwError("Expected '->' or '(' after variable");
+        ErrorHandler::throwError("Expected '->' or '(' after variable", lexer.getLocation(currentToken.position));
     }
 }
-std::vector<Value> Parser::parseFunctionArguments(const std::unordered_map<std::string, Value>& currentScope) {
+std::vector<Value> Parser::parseFunctionArguments(const ScopeStack& currentScope) {
     std::vector<Value> args;
     consume(Token::LPAREN);
-    Debugger::log("Parsing function arguments...");
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Parsing function arguments...");
     if (currentToken.type != Token::RPAREN) {
         while (true) {
             Value argVal;
-            Debugger::log("Current token in args: " + currentToken.text + " (type " + std::to_string(currentToken.type) + ")");
+            PDEV_TRACE(VERBOSE, TRACE_CALLS, "Current token in args: " + std::string(lexer.text(currentToken)) + " (type " + std::to_string(currentToken.type) + ")");
             if (currentToken.type == Token::STRING) {
-                argVal = currentToken.text;
-                Debugger::log("Parsed string argument: " + currentToken.text);
+                argVal = SymbolTable::string(currentToken.symbol);
+                PDEV_TRACE(VERBOSE, TRACE_CALLS, "Parsed string argument: " + std::string(lexer.text(currentToken)));
                 consume(Token::STRING);
             }
             else if (currentToken.type == Token::NUM) {
-                argVal = std::stoi(currentToken.text);
-                Debugger::log("Parsed numeric argument: " + currentToken.text);
+                argVal = lexer.number(currentToken);
+                PDEV_TRACE(VERBOSE, TRACE_CALLS, "Parsed numeric argument: " + std::string(lexer.text(currentToken)));
                 consume(Token::NUM);
             }
             else if (currentToken.type == Token::VAR) {
-                std::string varName = currentToken.text;
-                Debugger::log("Parsed variable argument: " + varName);
+                Symbol varName = currentToken.symbol;
+                PDEV_TRACE(VERBOSE, TRACE_CALLS, "Parsed variable argument: " + SymbolTable::name(varName));
                 consume(Token::VAR);
-                if (currentScope.find(varName) != currentScope.end()) {
-                    argVal = currentScope.at(varName);
-                    Debugger::log("Resolved variable " + varName + " to value");
+                if (const Value* found = currentScope.findInTop(varName)) {
+                    argVal = *found;
+                    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Resolved variable " + SymbolTable::name(varName) + " to value");
                 } else {
-                    ErrorHandler::throwError("Undefined variable: " + varName);
+                    ErrorHandler::throwError("Undefined variable: " + SymbolTable::name(varName), lexer.getLocation(currentToken.position));
                 }
             }
             else {
-                ErrorHandler::throwError("Invalid argument in function call");
+                ErrorHandler::throwError("Invalid argument in function call", lexer.getLocation(currentToken.position));
             }
             args.push_back(argVal);
             if (currentToken.type == Token::COMMA) {
                 consume(Token::COMMA);
-                Debugger::log("Found comma, continuing to next argument...");
+                PDEV_TRACE(VERBOSE, TRACE_CALLS, "Found comma, continuing to next argument...");
             } else {
                 break;
             }
         }
     }
     consume(Token::RPAREN);
-    Debugger::log("Completed parsing arguments. Total args: " + std::to_string(args.size()));
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Completed parsing arguments. Total args: " + std::to_string(args.size()));
     return args;
 }
-int Parser::parseFunctionCallArgsAndExecute(const std::string& funcName) {
-    Debugger::log("Detected function call to " + funcName);
-    auto args = parseFunctionArguments(variableStack.back());
-    if (functions.find(funcName) == functions.end())
-        ErrorHandler::throwError("Undefined function: " + funcName);
-    auto& func = functions[funcName];
+int64_t Parser::parseFunctionCallArgsAndExecute(Symbol funcName) {
+    PDEV_TRACE(DEBUG, TRACE_CALLS, "Detected function call to " + SymbolTable::name(funcName));
+    auto args = parseFunctionArguments(variableStack);
+    auto found = functions.find(funcName);
+    if (found == functions.end()) {
+        if (const HostFunctions::Entry* host = HostFunctions::find(funcName))
+            return callHostFunction(*host, args);
+        ErrorHandler::throwError("Undefined function: " + SymbolTable::name(funcName), lexer.getLocation(currentToken.position));
+    }
+    auto& func = found->second;
     if (args.size() != func.params.size())
-        ErrorHandler::throwError("Function " + funcName + " expects " + std::to_string(func.params.size()) + " arguments, but got " + std::to_string(args.size()));
-    Debugger::log("Executing function '" + funcName + "' at position " + std::to_string(func.position));
-    Debugger::log("Pushing return state: pos=" + std::to_string(lexer.getPosition()));
+        ErrorHandler::throwError("Function " + SymbolTable::name(funcName) + " expects " + std::to_string(func.params.size()) + " arguments, but got " + std::to_string(args.size()), lexer.getLocation(currentToken.position));
+    PDEV_TRACE(INFO, TRACE_CALLS, "Executing function '" + SymbolTable::name(funcName) + "' at position " + std::to_string(func.position));
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Pushing return state: pos=" + std::to_string(lexer.getPosition()));
     returnStates.push({lexer.getPosition(), currentToken});
     lexer.setPosition(func.position);
     currentToken = lexer.nextToken();
@@ -528,7 +555,7 @@ int Parser::parseFunctionCallArgsAndExecute(const std::string& funcName) {
     int braceCount = 1;
     hasReturnValue = false;
     lastReturnValue = 0;
-    Debugger::log("Entering function body...");
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Entering function body...");
     while (braceCount > 0 && currentToken.type != Token::END && !hasReturnValue) {
         if (currentToken.type == Token::LBRACE) {
             braceCount++;
@@ -540,54 +567,66 @@ int Parser::parseFunctionCallArgsAndExecute(const std::string& funcName) {
         } else
             statement();
     }
-    Debugger::log("Exiting function '" + funcName + "' with return value " + std::to_string(lastReturnValue));
+    PDEV_TRACE(DEBUG, TRACE_CALLS, "Exiting function '" + SymbolTable::name(funcName) + "' with return value " + std::to_string(lastReturnValue));
     popScope();
-    Debugger::log("Popping return state");
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Popping return state");
     auto [pos, savedToken] = returnStates.top();
     returnStates.pop();
-    Debugger::log("Restoring lexer position to " + std::to_string(pos));
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Restoring lexer position to " + std::to_string(pos));
     lexer.setPosition(pos);
     currentToken = savedToken;
-    Debugger::log("Finished executing function '" + funcName + "'");
+    PDEV_TRACE(VERBOSE, TRACE_CALLS, "Finished executing function '" + SymbolTable::name(funcName) + "'");
     return lastReturnValue;
 }
+// Calls here yield integers only, like the script functions this engine runs.
+int64_t Parser::callHostFunction(const HostFunctions::Entry& host, const std::vector<Value>& args) {
+    SourceLocation location = lexer.getLocation(currentToken.position);
+    if (args.size() != host.arity)
+        ErrorHandler::throwError("Function " + SymbolTable::name(host.name) + " expects " + std::to_string(host.arity) + " arguments, but got " + std::to_string(args.size()), location);
+    Value result;
+    try {
+        result = host.function(HostFunctions::Arguments(args.data(), args.size()));
+    } catch (const std::exception& e) {
+        ErrorHandler::throwError(e.what(), location);
+    }
+    if (!result.isInt())
+        ErrorHandler::throwError("Function " + SymbolTable::name(host.name) + " did not return an integer", location);
+    return result.asInt();
+}
 void Parser::parseWriteStatement() {
-    Debugger::log("Processing write statement");
+    PDEV_TRACE(VERBOSE, TRACE_PARSER, "Processing write statement");
     consume(Token::WRITE);
     consume(Token::LPAREN);
     if (currentToken.type == Token::VAR) {
-        std::string varName = currentToken.text;
+        Symbol varName = currentToken.symbol;
         consume(Token::VAR);
-        if (!variableStack.empty() && variableStack.back().find(varName) != variableStack.back().end()) {
-            const Value& val = variableStack.back().at(varName);
-            if (std::holds_alternative<int>(val))
-                std::cout << std::get<int>(val) << std::endl;
-            else
-                std::cout << std::get<std::string>(val) << std::endl;
+        const Value* found = variableStack.empty() ? nullptr : variableStack.findInTop(varName);
+        if (found) {
+            output.writeLine(*found);
         } else
-            Debugger::log("Undefined variable: " + varName);
+            PDEV_TRACE(INFO, TRACE_PARSER, "Undefined variable: " + SymbolTable::name(varName));
     } else if (currentToken.type == Token::STRING) {
-        std::cout << currentToken.text << std::endl;
+        output.writeLine(lexer.text(currentToken));
         consume(Token::STRING);
     } else
-        ErrorHandler::throwError("Invalid argument to write()");
+        ErrorHandler::throwError("Invalid argument to write()", lexer.getLocation(currentToken.position));
     consume(Token::RPAREN);
     consume(Token::SEMICOLON);
 }
 void Parser::parseFunctionDefinition() {
-    Debugger::log("Parsing function definition");
+    PDEV_TRACE(DEBUG, TRACE_PARSER, "Parsing function definition");
     consume(Token::FUNCTION);
     if (currentToken.type != Token::VAR)
-        ErrorHandler::throwError("Expected function name");
-    std::string funcName = currentToken.text;
+        ErrorHandler::throwError("Expected function name", lexer.getLocation(currentToken.position));
+    Symbol funcName = currentToken.symbol;
     consume(Token::VAR);
     consume(Token::LPAREN);
-    std::vector<std::string> params;
+    std::vector<Symbol> params;
     if (currentToken.type != Token::RPAREN) {
         while (true) {
             if (currentToken.type != Token::VAR)
-                ErrorHandler::throwError("Expected parameter name");
-            params.push_back(currentToken.text);
+                ErrorHandler::throwError("Expected parameter name", lexer.getLocation(currentToken.position));
+            params.push_back(currentToken.symbol);
             consume(Token::VAR);
             if (currentToken.type == Token::COMMA)
                 consume(Token::COMMA);
@@ -597,7 +636,7 @@ void Parser::parseFunctionDefinition() {
     }
     functions[funcName] = {lexer.getPosition(), params};
     consume(Token::RPAREN);
-    Debugger::log("Stored function '" + funcName + "' at position " + std::to_string(lexer.getPosition()));
+    PDEV_TRACE(INFO, TRACE_CALLS, "Stored function '" + SymbolTable::name(funcName) + "' at position " + std::to_string(lexer.getPosition()));
     consume(Token::LBRACE);
     int braceCount = 1;
     while (braceCount > 0) {
@@ -610,12 +649,12 @@ void Parser::parseFunctionDefinition() {
 void Parser::parse() {
     while (currentToken.type != Token::END) {
         if (currentToken.type == Token::RBRACE) {
-            Debugger::log("Skipping RBRACE at top level");
+            PDEV_TRACE(VERBOSE, TRACE_PARSER, "Skipping RBRACE at top level");
             currentToken = lexer.nextToken();
             continue;
         }
         if (currentToken.type == Token::FUNCTION) {
-            Debugger::log("Skipping over function definition at top level");
+            PDEV_TRACE(VERBOSE, TRACE_PARSER, "Skipping over function definition at top level");
             parseFunctionDefinition();
             continue;
         }
@@ -1,13 +1,14 @@
 #pragma once
+#include "hostfunctions.h"
 #include "lexer.h"
-#include <map>
+#include "output.h"
+#include "scopes.h"
+#include "value.h"
 #include <string>
 #include <vector>
-#include <variant>
 #include <stack>
 #include <functional>
 #include <unordered_map>
-using Value = std::variant<int, std::string>;
 class Parser {
 public:
     enum class UpdateOp {
@@ -18,17 +19,17 @@ public:
     };
     struct ForUpdateInfo {
         UpdateOp op = UpdateOp::NONE;
-        std::string varName;
+        Symbol varName = 0;
         Value assignedValue; 
         bool hasAssignedValue = false;
     };
-    Parser(Lexer lexer);
+    Parser(Lexer& lexer, OutputChannel& output = OutputChannel::standard());
     void parse();
     void statement();
     bool parseCondition();
     void parseIfStatement();
     void parseVarOrFunctionCall();
-    int parseFunctionCallArgsAndExecute(const std::string& funcName);
+    int64_t parseFunctionCallArgsAndExecute(Symbol funcName);
     void parseWriteStatement();
     void parseFunctionDefinition();
     void parseReturnStatement();
@@ -41,29 +42,32 @@ public:
     bool loopContinue = false;
     Value returnValue;
     bool hasReturnValue = false;
-    int lastReturnValue = 0;
+    int64_t lastReturnValue = 0;
     std::string forUpdateVarName;
     std::function<Value()> forUpdateExprFunc = nullptr;
-    std::vector<std::unordered_map<std::string, Value>> variableStack;
-    std::vector<Value> parseFunctionArguments(const std::unordered_map<std::string, Value>& currentScope);
+    ScopeStack variableStack;
+    std::vector<Value> parseFunctionArguments(const ScopeStack& currentScope);
 private:
     struct FunctionInfo {
         size_t position;
-        std::vector<std::string> params;
+        std::vector<Symbol> params;
     };
     void pushScope();
     void popScope();
-    Value lookupVariableValue(const std::string& name);  
+    Value lookupVariableValue(Symbol name);  
     void executeBlock();  
     void skipBlock();
     void skipRemainingElifElseBlocks();
-    void setVariableValue(const std::string& name, Value value);
-    std::map<std::string, FunctionInfo> functions;
+    void setVariableValue(Symbol name, Value value);
+    int64_t callHostFunction(const HostFunctions::Entry& host, const std::vector<Value>& args);
+    std::unordered_map<Symbol, FunctionInfo> functions;
     std::stack<std::pair<size_t, Token>> returnStates;
-    Lexer lexer;
+    Lexer& lexer;
+    OutputChannel& output;
     Token currentToken;
     void consume(Token::Type expected);
-    int expr();
-    int term();
-    int factor();
+    int64_t expr();
+    int64_t term();
+    int64_t factor();
+    int64_t arithmetic(bool exact, int64_t result);
 };
\ No newline at end of file
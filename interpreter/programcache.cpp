@@ -0,0 +1,333 @@
+#include "programcache.h"
+#include "hostfunctions.h"
+#include "scriptfile.h"
+#include "symbols.h"
+#include <cstdio>
+#include <cstring>
+#include <random>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+namespace {
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t instructionSize;
+    uint32_t opcodeCount;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint64_t hostSignature;
+    uint64_t payloadHash;
+    uint32_t functionCount;
+    uint32_t constantCount;
+    uint32_t stringCount;
+    uint32_t globalCount;
+    uint32_t messageCount;
+    uint32_t parallelLoopCount;
+    uint32_t hostCallCount;
+};
+constexpr char cacheMagic[4] = {'P', 'D', 'V', 'C'};
+#define PDEV_OPCODE_COUNT(name) +1
+constexpr uint32_t opcodeCount = 0 PDEV_OPCODES(PDEV_OPCODE_COUNT);
+#undef PDEV_OPCODE_COUNT
+class Writer {
+public:
+    explicit Writer(std::string& out) : out(out) {}
+    void bytes(const void* data, size_t size) {
+        out.append(static_cast<const char*>(data), size);
+    }
+    void u32(uint32_t value) { bytes(&value, sizeof(value)); }
+    void text(std::string_view value) {
+        u32(static_cast<uint32_t>(value.size()));
+        bytes(value.data(), value.size());
+    }
+private:
+    std::string& out;
+};
+class Reader {
+public:
+    Reader(const char* data, size_t size) : data(data), end(data + size) {}
+    bool bytes(void* target, size_t size) {
+        if (static_cast<size_t>(end - data) < size)
+            return false;
+        std::memcpy(target, data, size);
+        data += size;
+        return true;
+    }
+    bool u32(uint32_t& value) { return bytes(&value, sizeof(value)); }
+    bool text(std::string_view& value) {
+        uint32_t size;
+        if (!u32(size) || static_cast<size_t>(end - data) < size)
+            return false;
+        value = std::string_view(data, size);
+        data += size;
+        return true;
+    }
+    bool done() const { return data == end; }
+private:
+    const char* data;
+    const char* end;
+};
+// Opens a temporary file next to the cache that no other process can be
+// writing: the name carries the pid and a random suffix, and it is created
+// exclusively.
+std::FILE* createTemporary(const std::string& cachePath, std::string& tempPath) {
+    std::random_device random;
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        tempPath = cachePath + "." + std::to_string(getpid()) + "." + std::to_string(random()) + ".tmp";
+        if (std::FILE* file = std::fopen(tempPath.c_str(), "wbx"))
+            return file;
+    }
+    return nullptr;
+}
+// The vm trusts its bytecode, so every operand has to name an entry of the
+// table it indexes, a slot of its frame or an instruction of its function.
+bool validOperands(const CompiledProgram& program, size_t sourceSize) {
+    const size_t functionCount = program.functions.size();
+    for (const auto& function : program.functions) {
+        const auto& code = function.code;
+        const size_t frameSize = static_cast<size_t>(function.frameSize);
+        if (function.arity < 0 || function.frameSize < function.arity || function.maxStack < 0 || code.empty()
+            || (code.back().op != OpCode::HALT && code.back().op != OpCode::RETURN))
+            return false;
+        for (size_t position : function.positions) {
+            if (position > sourceSize)
+                return false;
+        }
+        for (const Instruction& instruction : code) {
+            const size_t arg = static_cast<uint32_t>(instruction.arg);
+            bool valid = true;
+            switch (instruction.op) {
+                case OpCode::PUSH_CONST: valid = arg < program.constants.size(); break;
+                case OpCode::PUSH_STRING: valid = arg < program.strings.size(); break;
+                case OpCode::LOAD_LOCAL: case OpCode::STORE_LOCAL: valid = arg < frameSize; break;
+                case OpCode::LOAD_GLOBAL: case OpCode::STORE_GLOBAL: valid = arg < program.globals.size(); break;
+                case OpCode::JUMP: case OpCode::JUMP_IF_FALSE: case OpCode::JUMP_IF_TRUE: valid = arg < code.size(); break;
+                case OpCode::INC_LOCAL: valid = instruction.slot < frameSize; break;
+                case OpCode::LOOP_ENTER: case OpCode::LOOP_NEXT:
+                    valid = instruction.slot < frameSize && arg < code.size() && instruction.compare <= OpCode::GE;
+                    break;
+                case OpCode::PARALLEL_FOR:
+                    valid = instruction.slot < frameSize && arg < program.parallelLoops.size() && instruction.compare <= OpCode::GE;
+                    break;
+                case OpCode::CALL: case OpCode::TAIL_CALL: valid = arg > 0 && arg < functionCount; break;
+                case OpCode::CALL_HOST: valid = arg < program.hostCalls.size(); break;
+                case OpCode::FAIL: valid = arg < program.messages.size(); break;
+                default: break;
+            }
+            if (!valid)
+                return false;
+        }
+    }
+    for (const auto& loop : program.parallelLoops) {
+        for (const auto& reduction : loop.reductions) {
+            size_t limit = reduction.global ? program.globals.size() : static_cast<size_t>(program.functions[loop.body].frameSize);
+            if (static_cast<size_t>(reduction.index) >= limit || reduction.position > sourceSize)
+                return false;
+        }
+    }
+    return true;
+}
+}
+std::string ProgramCache::pathFor(const std::string& scriptPath) {
+    return scriptPath + "c";
+}
+uint64_t ProgramCache::hashSource(std::string_view source) {
+    const uint64_t multiplier = 0x9E3779B97F4A7C15ull;
+    uint64_t hash = source.size() * multiplier;
+    size_t pos = 0;
+    for (; pos + 8 <= source.size(); pos += 8) {
+        uint64_t word;
+        std::memcpy(&word, source.data() + pos, 8);
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 32;
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, source.data() + pos, source.size() - pos);
+    hash = (hash ^ tail) * multiplier;
+    return hash ^ (hash >> 29);
+}
+bool ProgramCache::store(const std::string& cachePath, std::string_view source, const CompiledProgram& program) {
+    std::string payload;
+    Writer writer(payload);
+    for (const auto& function : program.functions) {
+        writer.text(function.name);
+        writer.u32(static_cast<uint32_t>(function.arity));
+        writer.u32(static_cast<uint32_t>(function.frameSize));
+        writer.u32(static_cast<uint32_t>(function.maxStack));
+        writer.u32(function.pure ? 1 : 0);
+        writer.u32(static_cast<uint32_t>(function.code.size()));
+        writer.bytes(function.code.data(), function.code.size() * sizeof(Instruction));
+        for (size_t position : function.positions)
+            writer.u32(static_cast<uint32_t>(position));
+    }
+    writer.bytes(program.constants.data(), program.constants.size() * sizeof(int64_t));
+    for (const auto& value : program.strings)
+        writer.text(value.asString());
+    for (Symbol global : program.globals)
+        writer.text(SymbolTable::name(global));
+    for (const auto& message : program.messages)
+        writer.text(message);
+    for (const auto& loop : program.parallelLoops) {
+        writer.u32(static_cast<uint32_t>(loop.body));
+        writer.u32(static_cast<uint32_t>(loop.step));
+        writer.u32(loop.unordered ? 1 : 0);
+        writer.u32(static_cast<uint32_t>(loop.reductions.size()));
+        for (const auto& reduction : loop.reductions) {
+            writer.u32(static_cast<uint32_t>(reduction.op));
+            writer.u32(reduction.global ? 1 : 0);
+            writer.u32(static_cast<uint32_t>(reduction.index));
+            writer.u32(static_cast<uint32_t>(reduction.position));
+            writer.text(reduction.name);
+        }
+    }
+    for (const auto& call : program.hostCalls) {
+        writer.text(SymbolTable::name(call.name));
+        writer.u32(static_cast<uint32_t>(call.arity));
+    }
+    CacheHeader header{};
+    std::memcpy(header.magic, cacheMagic, sizeof(cacheMagic));
+    header.version = FORMAT_VERSION;
+    header.instructionSize = sizeof(Instruction);
+    header.opcodeCount = opcodeCount;
+    header.sourceHash = hashSource(source);
+    header.sourceSize = source.size();
+    header.hostSignature = HostFunctions::signature();
+    header.payloadHash = hashSource(payload);
+    header.functionCount = static_cast<uint32_t>(program.functions.size());
+    header.constantCount = static_cast<uint32_t>(program.constants.size());
+    header.stringCount = static_cast<uint32_t>(program.strings.size());
+    header.globalCount = static_cast<uint32_t>(program.globals.size());
+    header.messageCount = static_cast<uint32_t>(program.messages.size());
+    header.parallelLoopCount = static_cast<uint32_t>(program.parallelLoops.size());
+    header.hostCallCount = static_cast<uint32_t>(program.hostCalls.size());
+    std::string tempPath;
+    std::FILE* file = createTemporary(cachePath, tempPath);
+    if (!file)
+        return false;
+    bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                   && std::fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+    if (std::fclose(file) != 0 || !written) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    // rename replaces an existing cache atomically, so readers see either
+    // the old file or the complete new one. The Windows runtime refuses to
+    // replace, so there the old cache has to go first.
+#ifdef _WIN32
+    std::remove(cachePath.c_str());
+#endif
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        std::remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+bool ProgramCache::load(const std::string& cachePath, std::string_view source, CompiledProgram& program) {
+    ScriptFile file;
+    if (!file.open(cachePath))
+        return false;
+    std::string_view bytes = file.text();
+    Reader reader(bytes.data(), bytes.size());
+    CacheHeader header;
+    if (!reader.bytes(&header, sizeof(header))
+        || std::memcmp(header.magic, cacheMagic, sizeof(cacheMagic)) != 0
+        || header.version != FORMAT_VERSION
+        || header.instructionSize != sizeof(Instruction)
+        || header.opcodeCount != opcodeCount
+        || header.sourceSize != source.size()
+        || header.sourceHash != hashSource(source)
+        || header.hostSignature != HostFunctions::signature()
+        || header.payloadHash != hashSource(bytes.substr(sizeof(header))))
+        return false;
+    CompiledProgram result;
+    result.functions.resize(header.functionCount);
+    for (auto& function : result.functions) {
+        std::string_view name;
+        uint32_t arity, frameSize, maxStack, pure, codeSize;
+        if (!reader.text(name) || !reader.u32(arity) || !reader.u32(frameSize) || !reader.u32(maxStack) || !reader.u32(pure) || !reader.u32(codeSize))
+            return false;
+        function.name = std::string(name);
+        function.arity = static_cast<int>(arity);
+        function.frameSize = static_cast<int>(frameSize);
+        function.maxStack = static_cast<int>(maxStack);
+        function.pure = pure != 0;
+        function.code.resize(codeSize);
+        function.positions.resize(codeSize);
+        if (!reader.bytes(function.code.data(), codeSize * sizeof(Instruction)))
+            return false;
+        for (const Instruction& instruction : function.code) {
+            if (static_cast<uint32_t>(instruction.op) >= opcodeCount)
+                return false;
+        }
+        for (auto& position : function.positions) {
+            uint32_t value;
+            if (!reader.u32(value))
+                return false;
+            position = value;
+        }
+    }
+    result.constants.resize(header.constantCount);
+    if (!reader.bytes(result.constants.data(), result.constants.size() * sizeof(int64_t)))
+        return false;
+    result.strings.reserve(header.stringCount);
+    for (uint32_t i = 0; i < header.stringCount; ++i) {
+        std::string_view text;
+        if (!reader.text(text))
+            return false;
+        result.strings.push_back(SymbolTable::string(SymbolTable::intern(text)));
+    }
+    result.globals.reserve(header.globalCount);
+    for (uint32_t i = 0; i < header.globalCount; ++i) {
+        std::string_view name;
+        if (!reader.text(name))
+            return false;
+        result.globals.push_back(SymbolTable::intern(name));
+    }
+    result.messages.reserve(header.messageCount);
+    for (uint32_t i = 0; i < header.messageCount; ++i) {
+        std::string_view message;
+        if (!reader.text(message))
+            return false;
+        result.messages.emplace_back(message);
+    }
+    result.parallelLoops.resize(header.parallelLoopCount);
+    for (auto& loop : result.parallelLoops) {
+        uint32_t body, step, unordered, reductionCount;
+        if (!reader.u32(body) || !reader.u32(step) || !reader.u32(unordered) || !reader.u32(reductionCount) || body >= header.functionCount)
+            return false;
+        loop.body = static_cast<int>(body);
+        loop.step = static_cast<int32_t>(step);
+        loop.unordered = unordered != 0;
+        loop.reductions.resize(reductionCount);
+        for (auto& reduction : loop.reductions) {
+            uint32_t op, global, index, position;
+            std::string_view name;
+            if (!reader.u32(op) || !reader.u32(global) || !reader.u32(index) || !reader.u32(position) || !reader.text(name))
+                return false;
+            if ((op != static_cast<uint32_t>(OpCode::ADD) && op != static_cast<uint32_t>(OpCode::MUL)) || (global && index >= header.globalCount))
+                return false;
+            reduction.op = static_cast<OpCode>(op);
+            reduction.global = global != 0;
+            reduction.index = static_cast<int>(index);
+            reduction.position = position;
+            reduction.name = std::string(name);
+        }
+    }
+    result.hostCalls.resize(header.hostCallCount);
+    for (auto& call : result.hostCalls) {
+        std::string_view name;
+        uint32_t arity;
+        if (!reader.text(name) || !reader.u32(arity))
+            return false;
+        call.name = SymbolTable::intern(name);
+        call.arity = static_cast<int>(arity);
+    }
+    if (!reader.done() || !validOperands(result, source.size()))
+        return false;
+    program = std::move(result);
+    return true;
+}
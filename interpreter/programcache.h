@@ -0,0 +1,21 @@
+#pragma once
+#include "bytecode.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+// Versioned on-disk form of a compiled program, keyed by a hash of the
+// script source. A valid cache file is memory-mapped and decoded straight
+// into bytecode, skipping lexing, parsing, resolution and compilation.
+// Symbols are stored by name and re-interned on load.
+class ProgramCache {
+public:
+    static constexpr uint32_t FORMAT_VERSION = 10;
+    static std::string pathFor(const std::string& scriptPath);
+    static uint64_t hashSource(std::string_view source);
+    // Returns false when the file is missing, from another format version
+    // or interpreter build, was written for different source text or
+    // against other host functions, or is damaged: its payload checksum
+    // or any instruction operand is off.
+    static bool load(const std::string& cachePath, std::string_view source, CompiledProgram& program);
+    static bool store(const std::string& cachePath, std::string_view source, const CompiledProgram& program);
+};
@@ -0,0 +1,483 @@
+#include "resolver.h"
+#include <algorithm>
+Resolver::Resolver(Program& program) : program(program) {}
+void Resolver::resolve() {
+    resolveStatements(program.statements);
+    for (auto& [name, func] : program.functions)
+        resolveFunction(*func);
+    markPureFunctions();
+    closedWorld = true;
+    inferTypes(program.statements, true);
+}
+// Top-level statements may arrive in several batches; globals assigned by
+// earlier batches stay global for functions resolved afterwards.
+void Resolver::resolveStatements(Block& statements) {
+    for (const auto& stmt : statements) {
+        if (stmt->kind == Stmt::ASSIGN)
+            topLevelGlobals.insert(stmt->name);
+    }
+    topLevel = true;
+    scopes.clear();
+    parallelScopes.clear();
+    nextSlot = 0;
+    frameSize = &program.frameSize;
+    for (auto& stmt : statements)
+        resolveStmt(*stmt);
+}
+void Resolver::resolveFunction(FunctionDef& func) {
+    topLevel = false;
+    scopes.clear();
+    parallelScopes.clear();
+    scopes.emplace_back();
+    nextSlot = 0;
+    frameSize = &func.frameSize;
+    for (const auto& param : func.params)
+        scopes.back()[param] = nextSlot++;
+    func.frameSize = nextSlot;
+    for (auto& stmt : func.body)
+        resolveStmt(*stmt);
+}
+int Resolver::global(Symbol name) {
+    auto found = program.globalIndex.find(name);
+    if (found != program.globalIndex.end())
+        return found->second;
+    int index = static_cast<int>(program.globals.size());
+    program.globals.push_back(name);
+    program.globalIndex[name] = index;
+    return index;
+}
+VarRef Resolver::load(Symbol name) {
+    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+        auto found = it->find(name);
+        if (found != it->end())
+            return {VarRef::LOCAL, found->second};
+    }
+    return {VarRef::GLOBAL, global(name)};
+}
+VarRef Resolver::store(Symbol name) {
+    VarRef ref = load(name);
+    if (ref.kind == VarRef::LOCAL)
+        return ref;
+    bool isGlobal = topLevel ? (scopes.empty() || declaredGlobals.count(name)) : topLevelGlobals.count(name) > 0;
+    if (isGlobal) {
+        if (scopes.empty())
+            declaredGlobals.insert(name);
+        return ref;
+    }
+    int slot = nextSlot++;
+    scopes.back()[name] = slot;
+    *frameSize = std::max(*frameSize, nextSlot);
+    return {VarRef::LOCAL, slot};
+}
+static bool sameVariable(const VarRef& a, const VarRef& b) {
+    return a.kind == b.kind && a.index == b.index;
+}
+static bool containsCall(const Expr& expr) {
+    if (expr.kind == Expr::CALL)
+        return true;
+    return (expr.left && containsCall(*expr.left)) || (expr.right && containsCall(*expr.right));
+}
+static bool containsCall(const Block& block);
+static bool containsCall(const Stmt& stmt) {
+    return (stmt.expr && containsCall(*stmt.expr))
+        || (stmt.init && containsCall(*stmt.init))
+        || (stmt.update && containsCall(*stmt.update))
+        || containsCall(stmt.body) || containsCall(stmt.elseBody);
+}
+static bool containsCall(const Block& block) {
+    return std::any_of(block.begin(), block.end(), [](const StmtPtr& stmt) { return containsCall(*stmt); });
+}
+static bool storesTo(const Block& block, const VarRef& ref);
+static bool storesTo(const Stmt& stmt, const VarRef& ref) {
+    switch (stmt.kind) {
+        case Stmt::ASSIGN:
+        case Stmt::INCREMENT:
+        case Stmt::DECREMENT:
+            return sameVariable(stmt.ref, ref);
+        default:
+            return (stmt.init && storesTo(*stmt.init, ref))
+                || (stmt.update && storesTo(*stmt.update, ref))
+                || storesTo(stmt.body, ref) || storesTo(stmt.elseBody, ref);
+    }
+}
+static bool storesTo(const Block& block, const VarRef& ref) {
+    return std::any_of(block.begin(), block.end(), [&](const StmtPtr& stmt) { return storesTo(*stmt, ref); });
+}
+// True when every evaluation of the bound inside the loop yields the same
+// value. Functions can assign globals, so globals only count when the body
+// makes no calls.
+static bool loopInvariant(const Expr& expr, const Stmt& loop, const VarRef& induction, bool bodyCalls) {
+    switch (expr.kind) {
+        case Expr::NUMBER:
+            return true;
+        case Expr::VARIABLE:
+            if (sameVariable(expr.ref, induction) || (expr.ref.kind == VarRef::GLOBAL && bodyCalls))
+                return false;
+            return !storesTo(loop.body, expr.ref);
+        case Expr::NEGATE:
+        case Expr::CHECK_INT:
+            return loopInvariant(*expr.left, loop, induction, bodyCalls);
+        case Expr::BINARY:
+            if (expr.op != BinaryOp::ADD && expr.op != BinaryOp::SUB && expr.op != BinaryOp::MUL && expr.op != BinaryOp::DIV)
+                return false;
+            return loopInvariant(*expr.left, loop, induction, bodyCalls) && loopInvariant(*expr.right, loop, induction, bodyCalls);
+        default:
+            return false;
+    }
+}
+// i++, i--, i -> i + c, i -> c + i and i -> i - c; zero for anything else,
+// including steps too wide for the instruction operand that holds them.
+static int updateStep(const Stmt& update, const VarRef& induction) {
+    if (!sameVariable(update.ref, induction))
+        return 0;
+    if (update.kind == Stmt::INCREMENT)
+        return 1;
+    if (update.kind == Stmt::DECREMENT)
+        return -1;
+    if (update.kind != Stmt::ASSIGN || update.expr->kind != Expr::BINARY)
+        return 0;
+    const Expr& expr = *update.expr;
+    auto isInduction = [&](const Expr& side) { return side.kind == Expr::VARIABLE && sameVariable(side.ref, induction); };
+    int64_t step = 0;
+    if (expr.op == BinaryOp::ADD && isInduction(*expr.left) && expr.right->kind == Expr::NUMBER)
+        step = expr.right->number;
+    else if (expr.op == BinaryOp::ADD && isInduction(*expr.right) && expr.left->kind == Expr::NUMBER)
+        step = expr.left->number;
+    else if (expr.op == BinaryOp::SUB && isInduction(*expr.left) && expr.right->kind == Expr::NUMBER && expr.right->number != INT64_MIN)
+        step = -expr.right->number;
+    return step >= -INT32_MAX && step <= INT32_MAX ? static_cast<int>(step) : 0;
+}
+void Resolver::markCountedLoop(Stmt& loop) {
+    loop.step = 0;
+    if (!loop.expr || !loop.update || loop.expr->kind != Expr::BINARY)
+        return;
+    const Expr& condition = *loop.expr;
+    switch (condition.op) {
+        case BinaryOp::LESS: case BinaryOp::LESS_EQUAL:
+        case BinaryOp::GREATER: case BinaryOp::GREATER_EQUAL:
+        case BinaryOp::NOT_EQUAL:
+            break;
+        default:
+            return;
+    }
+    if (condition.left->kind != Expr::VARIABLE || condition.left->ref.kind != VarRef::LOCAL)
+        return;
+    const VarRef& induction = condition.left->ref;
+    int step = updateStep(*loop.update, induction);
+    if (step == 0 || storesTo(loop.body, induction))
+        return;
+    if (!loopInvariant(*condition.right, loop, induction, containsCall(loop.body)))
+        return;
+    loop.step = step;
+}
+// Collects what a function body does that matters for purity: whether it
+// touches global state or writes output, and which functions it calls.
+static bool touchesGlobals(const Expr& expr, std::vector<Symbol>& calls) {
+    if (expr.kind == Expr::VARIABLE && expr.ref.kind == VarRef::GLOBAL)
+        return true;
+    if (expr.kind == Expr::CALL)
+        calls.push_back(expr.symbol);
+    for (const auto& arg : expr.args) {
+        if (touchesGlobals(*arg, calls))
+            return true;
+    }
+    return (expr.left && touchesGlobals(*expr.left, calls)) || (expr.right && touchesGlobals(*expr.right, calls));
+}
+static bool touchesGlobals(const Block& block, std::vector<Symbol>& calls);
+static bool touchesGlobals(const Stmt& stmt, std::vector<Symbol>& calls) {
+    switch (stmt.kind) {
+        case Stmt::WRITE:
+            return true;
+        case Stmt::ASSIGN:
+        case Stmt::INCREMENT:
+        case Stmt::DECREMENT:
+            if (stmt.ref.kind == VarRef::GLOBAL)
+                return true;
+            break;
+        default:
+            break;
+    }
+    return (stmt.expr && touchesGlobals(*stmt.expr, calls))
+        || (stmt.init && touchesGlobals(*stmt.init, calls))
+        || (stmt.update && touchesGlobals(*stmt.update, calls))
+        || touchesGlobals(stmt.body, calls) || touchesGlobals(stmt.elseBody, calls);
+}
+static bool touchesGlobals(const Block& block, std::vector<Symbol>& calls) {
+    return std::any_of(block.begin(), block.end(), [&](const StmtPtr& stmt) { return touchesGlobals(*stmt, calls); });
+}
+// Starts from every function that is pure on its own and drops those that
+// call an impure or undefined function until nothing changes, so mutually
+// recursive pure functions stay pure. Reruns over all functions because a
+// later batch may redefine a callee.
+void Resolver::markPureFunctions() {
+    std::unordered_map<FunctionDef*, std::vector<Symbol>> callees;
+    for (auto& [name, func] : program.functions) {
+        std::vector<Symbol> calls;
+        func->pure = !touchesGlobals(func->body, calls);
+        if (func->pure)
+            callees[func.get()] = std::move(calls);
+    }
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& [func, calls] : callees) {
+            if (!func->pure)
+                continue;
+            for (Symbol callee : calls) {
+                auto found = program.functions.find(callee);
+                if (found == program.functions.end() || !found->second->pure) {
+                    func->pure = false;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+// A store inside a parallel for only reaches the worker's copy, so it has
+// to target a variable of the loop's own scope or one of its reductions,
+// which in turn must be fine for the loop around it.
+void Resolver::checkParallelStore(const Stmt& stmt) {
+    for (auto scope = parallelScopes.rbegin(); scope != parallelScopes.rend(); ++scope) {
+        if (stmt.ref.kind == VarRef::LOCAL && stmt.ref.index >= scope->base)
+            return;
+        const auto& reductions = scope->parallel->reductions;
+        bool reduced = std::any_of(reductions.begin(), reductions.end(), [&](const Parallel::Reduction& reduction) {
+            return sameVariable(reduction.ref, stmt.ref);
+        });
+        if (!reduced) {
+            if (!scope->parallel->sharedStore)
+                scope->parallel->sharedStore = &stmt;
+            return;
+        }
+    }
+}
+void Resolver::resolveBlock(Block& block) {
+    int savedSlot = nextSlot;
+    scopes.emplace_back();
+    for (auto& stmt : block)
+        resolveStmt(*stmt);
+    scopes.pop_back();
+    nextSlot = savedSlot;
+}
+void Resolver::resolveStmt(Stmt& stmt) {
+    switch (stmt.kind) {
+        case Stmt::ASSIGN:
+            resolveExpr(*stmt.expr);
+            stmt.ref = store(stmt.name);
+            checkParallelStore(stmt);
+            break;
+        case Stmt::INCREMENT:
+        case Stmt::DECREMENT:
+            stmt.ref = load(stmt.name);
+            checkParallelStore(stmt);
+            break;
+        case Stmt::CALL:
+        case Stmt::WRITE:
+            resolveExpr(*stmt.expr);
+            break;
+        case Stmt::RETURN:
+            if (stmt.expr)
+                resolveExpr(*stmt.expr);
+            stmt.tailCall = !topLevel && parallelScopes.empty() && stmt.expr && stmt.expr->kind == Expr::CALL;
+            break;
+        case Stmt::IF:
+            resolveExpr(*stmt.expr);
+            resolveBlock(stmt.body);
+            resolveBlock(stmt.elseBody);
+            break;
+        case Stmt::WHILE:
+        case Stmt::DO_WHILE:
+            resolveExpr(*stmt.expr);
+            resolveBlock(stmt.body);
+            break;
+        case Stmt::FOR: {
+            if (stmt.parallel) {
+                stmt.parallel->sharedStore = nullptr;
+                for (auto& reduction : stmt.parallel->reductions)
+                    reduction.ref = load(reduction.name);
+            }
+            int savedSlot = nextSlot;
+            scopes.emplace_back();
+            if (stmt.init)
+                resolveStmt(*stmt.init);
+            // The initializer still runs on the thread that reaches the
+            // loop; only the rest is checked.
+            if (stmt.parallel)
+                parallelScopes.push_back({stmt.parallel.get(), savedSlot});
+            if (stmt.expr)
+                resolveExpr(*stmt.expr);
+            resolveBlock(stmt.body);
+            if (stmt.update)
+                resolveStmt(*stmt.update);
+            markCountedLoop(stmt);
+            if (stmt.parallel)
+                parallelScopes.pop_back();
+            scopes.pop_back();
+            nextSlot = savedSlot;
+            break;
+        }
+        case Stmt::BLOCK:
+            resolveBlock(stmt.body);
+            break;
+        case Stmt::BREAK:
+        case Stmt::CONTINUE:
+        case Stmt::PASS:
+            break;
+    }
+}
+void Resolver::resolveExpr(Expr& expr) {
+    switch (expr.kind) {
+        case Expr::VARIABLE:
+            expr.ref = load(expr.symbol);
+            break;
+        case Expr::NEGATE:
+        case Expr::CHECK_INT:
+            resolveExpr(*expr.left);
+            break;
+        case Expr::BINARY:
+            resolveExpr(*expr.left);
+            resolveExpr(*expr.right);
+            break;
+        case Expr::CALL:
+            for (auto& arg : expr.args)
+                resolveExpr(*arg);
+            break;
+        case Expr::NUMBER:
+        case Expr::STRING:
+            break;
+    }
+}
+// Optimistic type inference: every slot, global and function result starts
+// out as an integer and is demoted when a store, an argument or a return
+// may carry a string, until nothing changes. A slot is shared by variables
+// of sibling scopes, so it stays an integer only if all of them do. Nothing
+// else reaches a read: a name read before any store in scope resolves to a
+// global, and reading an unassigned global fails.
+void Resolver::inferTypes(Block& statements, bool functions) {
+    if (functions) {
+        intLocals.clear();
+        for (auto& [name, func] : program.functions) {
+            func->returnsInt = true;
+            std::vector<uint8_t>& slots = intLocals[func.get()];
+            slots.assign(func->frameSize, 1);
+            if (!closedWorld)
+                std::fill_n(slots.begin(), func->params.size(), 0);
+        }
+    }
+    intTopLevel.assign(program.frameSize, 1);
+    intGlobals.assign(program.globals.size(), closedWorld ? 1 : 0);
+    do {
+        typesChanged = false;
+        inferring = nullptr;
+        intSlots = &intTopLevel;
+        inferBlock(statements);
+        if (!functions)
+            continue;
+        for (auto& [name, func] : program.functions) {
+            inferring = func.get();
+            intSlots = &intLocals[func.get()];
+            inferBlock(func->body);
+        }
+    } while (typesChanged);
+    intSlots = &intTopLevel;
+    annotateBlock(statements);
+    if (!functions)
+        return;
+    for (auto& [name, func] : program.functions) {
+        intSlots = &intLocals[func.get()];
+        annotateBlock(func->body);
+    }
+}
+bool Resolver::inferredInt(const Expr& expr) const {
+    switch (expr.kind) {
+        case Expr::NUMBER:
+        case Expr::NEGATE:
+        case Expr::BINARY:
+        case Expr::CHECK_INT:
+            return true;
+        case Expr::STRING:
+            return false;
+        case Expr::VARIABLE:
+            if (expr.ref.kind == VarRef::LOCAL)
+                return (*intSlots)[expr.ref.index] != 0;
+            return expr.ref.kind == VarRef::GLOBAL && intGlobals[expr.ref.index] != 0;
+        case Expr::CALL: {
+            auto found = program.functions.find(expr.symbol);
+            return found != program.functions.end() && found->second->returnsInt;
+        }
+    }
+    return false;
+}
+void Resolver::demote(const VarRef& ref) {
+    std::vector<uint8_t>& flags = ref.kind == VarRef::LOCAL ? *intSlots : intGlobals;
+    if (ref.kind != VarRef::UNRESOLVED && flags[ref.index]) {
+        flags[ref.index] = 0;
+        typesChanged = true;
+    }
+}
+void Resolver::inferBlock(const Block& block) {
+    for (const auto& stmt : block)
+        inferStmt(*stmt);
+}
+void Resolver::inferStmt(const Stmt& stmt) {
+    if (stmt.expr)
+        inferExpr(*stmt.expr);
+    if (stmt.kind == Stmt::ASSIGN && !inferredInt(*stmt.expr))
+        demote(stmt.ref);
+    if (stmt.kind == Stmt::RETURN && inferring && inferring->returnsInt && stmt.expr && !inferredInt(*stmt.expr)) {
+        inferring->returnsInt = false;
+        typesChanged = true;
+    }
+    if (stmt.init)
+        inferStmt(*stmt.init);
+    if (stmt.update)
+        inferStmt(*stmt.update);
+    inferBlock(stmt.body);
+    inferBlock(stmt.elseBody);
+}
+// Only a whole program knows every call site, so only then do arguments
+// decide the callee's parameter types.
+void Resolver::inferExpr(const Expr& expr) {
+    if (expr.left)
+        inferExpr(*expr.left);
+    if (expr.right)
+        inferExpr(*expr.right);
+    for (const auto& arg : expr.args)
+        inferExpr(*arg);
+    if (expr.kind != Expr::CALL || !closedWorld)
+        return;
+    auto found = program.functions.find(expr.symbol);
+    if (found == program.functions.end())
+        return;
+    std::vector<uint8_t>& params = intLocals[found->second.get()];
+    for (size_t i = 0; i < expr.args.size() && i < found->second->params.size(); ++i) {
+        if (params[i] && !inferredInt(*expr.args[i])) {
+            params[i] = 0;
+            typesChanged = true;
+        }
+    }
+}
+void Resolver::annotateBlock(Block& block) {
+    for (auto& stmt : block)
+        annotateStmt(*stmt);
+}
+void Resolver::annotateStmt(Stmt& stmt) {
+    if (stmt.expr)
+        annotateExpr(*stmt.expr);
+    if (stmt.init)
+        annotateStmt(*stmt.init);
+    if (stmt.update)
+        annotateStmt(*stmt.update);
+    annotateBlock(stmt.body);
+    annotateBlock(stmt.elseBody);
+}
+void Resolver::annotateExpr(Expr& expr) {
+    expr.isInt = inferredInt(expr);
+    if (expr.left)
+        annotateExpr(*expr.left);
+    if (expr.right)
+        annotateExpr(*expr.right);
+    for (auto& arg : expr.args)
+        annotateExpr(*arg);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include "ast.h"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+class Resolver {
+public:
+    Resolver(Program& program);
+    void resolve();
+    void resolveStatements(Block& statements);
+    void resolveFunction(FunctionDef& func);
+    void markPureFunctions();
+    // Proves which locals, globals, parameters and function results always
+    // hold integers and marks the expressions reading them (Expr::isInt).
+    // resolve() sees the whole program; a session infers each batch on its
+    // own, plus every function when the batch defines some, and since a
+    // later batch may pass anything, parameters and globals stay unproven.
+    void inferTypes(Block& statements, bool functions);
+private:
+    Program& program;
+    bool closedWorld = false;
+    // Inference state: one flag per global, per top-level slot and per
+    // slot of each function, cleared when a string may be stored there.
+    std::vector<uint8_t> intGlobals;
+    std::vector<uint8_t> intTopLevel;
+    std::unordered_map<const FunctionDef*, std::vector<uint8_t>> intLocals;
+    std::vector<uint8_t>* intSlots = nullptr;
+    FunctionDef* inferring = nullptr;
+    bool typesChanged = false;
+    bool topLevel = true;
+    int nextSlot = 0;
+    int* frameSize = nullptr;
+    std::vector<std::unordered_map<Symbol, int>> scopes;
+    std::unordered_set<Symbol> topLevelGlobals;
+    std::unordered_set<Symbol> declaredGlobals;
+    // Enclosing parallel for loops, innermost last, with the first slot
+    // private to each.
+    struct ParallelScope {
+        Parallel* parallel;
+        int base;
+    };
+    std::vector<ParallelScope> parallelScopes;
+    void resolveBlock(Block& block);
+    void resolveStmt(Stmt& stmt);
+    void resolveExpr(Expr& expr);
+    void markCountedLoop(Stmt& loop);
+    void checkParallelStore(const Stmt& stmt);
+    VarRef load(Symbol name);
+    VarRef store(Symbol name);
+    int global(Symbol name);
+    bool inferredInt(const Expr& expr) const;
+    void demote(const VarRef& ref);
+    void inferBlock(const Block& block);
+    void inferStmt(const Stmt& stmt);
+    void inferExpr(const Expr& expr);
+    void annotateBlock(Block& block);
+    void annotateStmt(Stmt& stmt);
+    void annotateExpr(Expr& expr);
+};
\ No newline at end of file
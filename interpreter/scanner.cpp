@@ -0,0 +1,191 @@
+#include "scanner.h"
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define PDEV_SCAN_SSE2 1
+#endif
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define PDEV_SCAN_AVX2 1
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+static size_t skipWhitespaceScalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && hasCharClass(data[pos], CHAR_SPACE)) ++pos;
+    return pos;
+}
+static size_t skipIdentifierScalar(const char* data, size_t pos, size_t size) {
+    while (pos < size && hasCharClass(data[pos], CHAR_IDENT)) ++pos;
+    return pos;
+}
+static size_t findByteScalar(const char* data, size_t pos, size_t size, char target) {
+    while (pos < size && data[pos] != target) ++pos;
+    return pos;
+}
+static size_t findCommentEndScalar(const char* data, size_t pos, size_t size) {
+    while (pos + 1 < size && !(data[pos] == '*' && data[pos + 1] == '/')) ++pos;
+    return pos + 1 < size ? pos : size;
+}
+static inline unsigned firstSetBit(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return static_cast<unsigned>(index);
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+#ifdef PDEV_SCAN_SSE2
+static inline __m128i inRange16(__m128i c, char low, char span) {
+    __m128i shifted = _mm_sub_epi8(c, _mm_set1_epi8(low));
+    return _mm_cmpeq_epi8(_mm_subs_epu8(shifted, _mm_set1_epi8(span)), _mm_setzero_si128());
+}
+static inline uint32_t whitespaceMask16(__m128i c) {
+    __m128i space = _mm_cmpeq_epi8(c, _mm_set1_epi8(' '));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(space, inRange16(c, '\t', '\r' - '\t'))));
+}
+static inline uint32_t identifierMask16(__m128i c) {
+    __m128i alpha = inRange16(_mm_or_si128(c, _mm_set1_epi8(0x20)), 'a', 'z' - 'a');
+    __m128i digit = inRange16(c, '0', 9);
+    __m128i underscore = _mm_cmpeq_epi8(c, _mm_set1_epi8('_'));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), underscore)));
+}
+static size_t skipWhitespaceSse2(const char* data, size_t pos, size_t size) {
+    while (pos + 16 <= size) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t stop = ~whitespaceMask16(c) & 0xFFFFu;
+        if (stop)
+            return pos + firstSetBit(stop);
+        pos += 16;
+    }
+    return skipWhitespaceScalar(data, pos, size);
+}
+static size_t skipIdentifierSse2(const char* data, size_t pos, size_t size) {
+    while (pos + 16 <= size) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t stop = ~identifierMask16(c) & 0xFFFFu;
+        if (stop)
+            return pos + firstSetBit(stop);
+        pos += 16;
+    }
+    return skipIdentifierScalar(data, pos, size);
+}
+static size_t findByteSse2(const char* data, size_t pos, size_t size, char target) {
+    __m128i needle = _mm_set1_epi8(target);
+    while (pos + 16 <= size) {
+        __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        uint32_t hit = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, needle)));
+        if (hit)
+            return pos + firstSetBit(hit);
+        pos += 16;
+    }
+    return findByteScalar(data, pos, size, target);
+}
+static size_t findCommentEndSse2(const char* data, size_t pos, size_t size) {
+    while (true) {
+        pos = findByteSse2(data, pos, size, '*');
+        if (pos + 1 >= size)
+            return size;
+        if (data[pos + 1] == '/')
+            return pos;
+        ++pos;
+    }
+}
+#endif
+#ifdef PDEV_SCAN_AVX2
+__attribute__((target("avx2"))) static inline __m256i inRange32(__m256i c, char low, char span) {
+    __m256i shifted = _mm256_sub_epi8(c, _mm256_set1_epi8(low));
+    return _mm256_cmpeq_epi8(_mm256_subs_epu8(shifted, _mm256_set1_epi8(span)), _mm256_setzero_si256());
+}
+__attribute__((target("avx2"))) static size_t skipWhitespaceAvx2(const char* data, size_t pos, size_t size) {
+    while (pos + 32 <= size) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(c, _mm256_set1_epi8(' ')), inRange32(c, '\t', '\r' - '\t'));
+        uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(space));
+        if (stop)
+            return pos + firstSetBit(stop);
+        pos += 32;
+    }
+    return skipWhitespaceSse2(data, pos, size);
+}
+__attribute__((target("avx2"))) static size_t skipIdentifierAvx2(const char* data, size_t pos, size_t size) {
+    while (pos + 32 <= size) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        __m256i alpha = inRange32(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), 'a', 'z' - 'a');
+        __m256i digit = inRange32(c, '0', 9);
+        __m256i underscore = _mm256_cmpeq_epi8(c, _mm256_set1_epi8('_'));
+        uint32_t stop = ~static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), underscore)));
+        if (stop)
+            return pos + firstSetBit(stop);
+        pos += 32;
+    }
+    return skipIdentifierSse2(data, pos, size);
+}
+__attribute__((target("avx2"))) static size_t findByteAvx2(const char* data, size_t pos, size_t size, char target) {
+    __m256i needle = _mm256_set1_epi8(target);
+    while (pos + 32 <= size) {
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + pos));
+        uint32_t hit = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(c, needle)));
+        if (hit)
+            return pos + firstSetBit(hit);
+        pos += 32;
+    }
+    return findByteSse2(data, pos, size, target);
+}
+__attribute__((target("avx2"))) static size_t findCommentEndAvx2(const char* data, size_t pos, size_t size) {
+    while (true) {
+        pos = findByteAvx2(data, pos, size, '*');
+        if (pos + 1 >= size)
+            return size;
+        if (data[pos + 1] == '/')
+            return pos;
+        ++pos;
+    }
+}
+#endif
+ScanMode resolveScanMode(ScanMode mode) {
+#ifdef PDEV_SCAN_AVX2
+    bool avx2 = __builtin_cpu_supports("avx2");
+#else
+    bool avx2 = false;
+#endif
+#ifdef PDEV_SCAN_SSE2
+    bool sse2 = true;
+#else
+    bool sse2 = false;
+#endif
+    if (mode == ScanMode::AUTO)
+        return avx2 ? ScanMode::AVX2 : sse2 ? ScanMode::SSE2 : ScanMode::SCALAR;
+    if (mode == ScanMode::AVX2 && !avx2)
+        mode = ScanMode::SSE2;
+    if (mode == ScanMode::SSE2 && !sse2)
+        mode = ScanMode::SCALAR;
+    return mode;
+}
+const ScanKernels& scanKernels(ScanMode mode) {
+    static const ScanKernels scalar = {skipWhitespaceScalar, skipIdentifierScalar, findByteScalar, findCommentEndScalar};
+#ifdef PDEV_SCAN_SSE2
+    static const ScanKernels sse2 = {skipWhitespaceSse2, skipIdentifierSse2, findByteSse2, findCommentEndSse2};
+#endif
+#ifdef PDEV_SCAN_AVX2
+    static const ScanKernels avx2 = {skipWhitespaceAvx2, skipIdentifierAvx2, findByteAvx2, findCommentEndAvx2};
+#endif
+    switch (resolveScanMode(mode)) {
+#ifdef PDEV_SCAN_AVX2
+        case ScanMode::AVX2: return avx2;
+#endif
+#ifdef PDEV_SCAN_SSE2
+        case ScanMode::SSE2: return sse2;
+#endif
+        default: return scalar;
+    }
+}
+const char* scanModeName(ScanMode mode) {
+    switch (mode) {
+        case ScanMode::AUTO: return "auto";
+        case ScanMode::SCALAR: return "scalar";
+        case ScanMode::SSE2: return "sse2";
+        case ScanMode::AVX2: return "avx2";
+    }
+    return "unknown";
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+enum class ScanMode {
+    AUTO,
+    SCALAR,
+    SSE2,
+    AVX2
+};
+enum CharClass : uint8_t {
+    CHAR_SPACE = 1,
+    CHAR_DIGIT = 2,
+    CHAR_IDENT_START = 4,
+    CHAR_IDENT = 8
+};
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c) {
+        uint8_t bits = 0;
+        if (c == ' ' || (c >= '\t' && c <= '\r')) bits |= CHAR_SPACE;
+        if (c >= '0' && c <= '9') bits |= CHAR_DIGIT | CHAR_IDENT;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') bits |= CHAR_IDENT_START | CHAR_IDENT;
+        table[c] = bits;
+    }
+    return table;
+}
+inline constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+inline bool hasCharClass(char c, uint8_t bits) {
+    return (charClasses[static_cast<unsigned char>(c)] & bits) != 0;
+}
+struct ScanKernels {
+    size_t (*skipWhitespace)(const char* data, size_t pos, size_t size);
+    size_t (*skipIdentifier)(const char* data, size_t pos, size_t size);
+    size_t (*findByte)(const char* data, size_t pos, size_t size, char target);
+    size_t (*findCommentEnd)(const char* data, size_t pos, size_t size);
+};
+ScanMode resolveScanMode(ScanMode mode);
+const ScanKernels& scanKernels(ScanMode mode);
+const char* scanModeName(ScanMode mode);
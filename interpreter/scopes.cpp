@@ -0,0 +1,37 @@
+#include "scopes.h"
+void ScopeStack::push() {
+    marks.push_back(entries.size());
+}
+void ScopeStack::pop() {
+    entries.resize(marks.back());
+    marks.pop_back();
+}
+bool ScopeStack::empty() const {
+    return marks.empty();
+}
+size_t ScopeStack::depth() const {
+    return marks.size();
+}
+Value* ScopeStack::find(Symbol name) {
+    for (size_t i = entries.size(); i-- > 0;) {
+        if (entries[i].name == name)
+            return &entries[i].value;
+    }
+    return nullptr;
+}
+const Value* ScopeStack::findInTop(Symbol name) const {
+    for (size_t i = entries.size(); i-- > marks.back();) {
+        if (entries[i].name == name)
+            return &entries[i].value;
+    }
+    return nullptr;
+}
+void ScopeStack::set(Symbol name, Value value) {
+    for (size_t i = entries.size(); i-- > marks.back();) {
+        if (entries[i].name == name) {
+            entries[i].value = std::move(value);
+            return;
+        }
+    }
+    entries.push_back({name, std::move(value)});
+}
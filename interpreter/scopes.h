@@ -0,0 +1,25 @@
+#pragma once
+#include "symbols.h"
+#include "value.h"
+#include <vector>
+// Block scopes for the execute-while-parsing engine. All scopes share one
+// flat entry buffer; pushing records a mark and popping truncates back to
+// it, so once the buffer has grown, entering and leaving blocks never
+// touches the heap.
+class ScopeStack {
+public:
+    void push();
+    void pop();
+    bool empty() const;
+    size_t depth() const;
+    Value* find(Symbol name);
+    const Value* findInTop(Symbol name) const;
+    void set(Symbol name, Value value);
+private:
+    struct Entry {
+        Symbol name;
+        Value value;
+    };
+    std::vector<Entry> entries;
+    std::vector<size_t> marks;
+};
@@ -0,0 +1,94 @@
+#include "scriptfile.h"
+#include <fstream>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+ScriptFile::~ScriptFile() {
+    close();
+}
+void ScriptFile::close() {
+    if (isMapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap(const_cast<char*>(data), size);
+#endif
+    }
+    data = nullptr;
+    size = 0;
+    isMapped = false;
+    fallback.clear();
+}
+#ifdef _WIN32
+static const char* mapFile(const std::string& path, size_t& size) {
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        return nullptr;
+    LARGE_INTEGER length;
+    const char* view = nullptr;
+    if (GetFileType(file) == FILE_TYPE_DISK && GetFileSizeEx(file, &length) && length.QuadPart > 0) {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+            CloseHandle(mapping);
+            size = static_cast<size_t>(length.QuadPart);
+        }
+    }
+    CloseHandle(file);
+    return view;
+}
+#else
+static const char* mapFile(const std::string& path, size_t& size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    const char* view = nullptr;
+    if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            view = static_cast<const char*>(mapped);
+            size = static_cast<size_t>(info.st_size);
+#ifdef MADV_SEQUENTIAL
+            madvise(mapped, size, MADV_SEQUENTIAL);
+#endif
+        }
+    }
+    ::close(fd);
+    return view;
+}
+#endif
+bool ScriptFile::open(const std::string& path) {
+    close();
+    if ((data = mapFile(path, size))) {
+        isMapped = true;
+        return true;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    return read(file);
+}
+bool ScriptFile::read(std::istream& in) {
+    close();
+    char chunk[1 << 16];
+    while (in.read(chunk, sizeof(chunk)) || in.gcount() > 0)
+        fallback.append(chunk, static_cast<size_t>(in.gcount()));
+    if (in.bad())
+        return false;
+    data = fallback.data();
+    size = fallback.size();
+    return true;
+}
+std::string_view ScriptFile::text() const {
+    return std::string_view(data, size);
+}
+bool ScriptFile::mapped() const {
+    return isMapped;
+}
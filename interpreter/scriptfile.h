@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+// Read-only view of a script's bytes. Regular files are memory-mapped so
+// the lexer tokenizes straight out of the page cache; pipes and other
+// unmappable inputs fall back to a single buffered read.
+class ScriptFile {
+public:
+    ScriptFile() = default;
+    ScriptFile(const ScriptFile&) = delete;
+    ScriptFile& operator=(const ScriptFile&) = delete;
+    ~ScriptFile();
+    bool open(const std::string& path);
+    // Reads all of `in`, such as std::cin for a script piped in as `-`.
+    bool read(std::istream& in);
+    std::string_view text() const;
+    bool mapped() const;
+private:
+    const char* data = nullptr;
+    size_t size = 0;
+    bool isMapped = false;
+    std::string fallback;
+    void close();
+};
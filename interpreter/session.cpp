@@ -0,0 +1,38 @@
+#include "session.h"
+#include "astbuilder.h"
+#include "optimizer.h"
+Session::Session(OutputChannel& output)
+    : resolver(program), evaluator(program, emptySourceMap, output) {}
+void Session::eval(std::string_view snippet) {
+    Lexer lexer(snippet);
+    Program batch = AstBuilder(lexer).build();
+    execute(batch, lexer);
+}
+void Session::execute(Program& batch, const Lexer& lexer) {
+    Optimizer(batch).optimize();
+    if (!batch.functions.empty()) {
+        auto map = std::make_shared<const SourceMap>(lexer.getSourceMap());
+        for (auto& [name, func] : batch.functions) {
+            func->sourceMap = map;
+            program.functions[name] = func;
+        }
+        ++program.functionVersion;
+    }
+    resolver.resolveStatements(batch.statements);
+    for (auto& [name, func] : batch.functions)
+        resolver.resolveFunction(*func);
+    if (!batch.functions.empty())
+        resolver.markPureFunctions();
+    resolver.inferTypes(batch.statements, !batch.functions.empty());
+    evaluator.setSourceMap(lexer.getSourceMap());
+    evaluator.execute(batch.statements);
+}
+const Value* Session::global(std::string_view name) const {
+    auto found = program.globalIndex.find(SymbolTable::intern(name));
+    if (found == program.globalIndex.end())
+        return nullptr;
+    return evaluator.global(found->second);
+}
+bool Session::hasFunction(std::string_view name) const {
+    return program.functions.count(SymbolTable::intern(name)) > 0;
+}
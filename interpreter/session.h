@@ -0,0 +1,32 @@
+#pragma once
+#include "ast.h"
+#include "evaluator.h"
+#include "lexer.h"
+#include "output.h"
+#include "resolver.h"
+#include <string>
+#include <string_view>
+// Long-lived interpreter state for REPLs and embedding hosts. Globals,
+// functions and resolved code persist across eval() calls; each snippet
+// is lexed, parsed and resolved on its own against the existing state,
+// so earlier snippets are never parsed again.
+class Session {
+public:
+    Session(OutputChannel& output = OutputChannel::standard());
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+    // Throws IncompleteInputError when the snippet ends mid-statement and
+    // std::runtime_error for any other failure. Nothing in a snippet runs
+    // unless all of it parses.
+    void eval(std::string_view snippet);
+    // Adds an already parsed batch to the session and runs its top-level
+    // statements. `lexer` is the one the batch was parsed from.
+    void execute(Program& batch, const Lexer& lexer);
+    const Value* global(std::string_view name) const;
+    bool hasFunction(std::string_view name) const;
+private:
+    Program program;
+    SourceMap emptySourceMap;
+    Resolver resolver;
+    Evaluator evaluator;
+};
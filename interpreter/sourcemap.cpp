@@ -0,0 +1,24 @@
+#include "sourcemap.h"
+#include <algorithm>
+SourceMap::SourceMap(std::string_view source, const ScanKernels& scan, SourceLocation origin) : size(source.size()), origin(origin) {
+    lineStarts.push_back(0);
+    for (size_t pos = scan.findByte(source.data(), 0, size, '\n'); pos < size; pos = scan.findByte(source.data(), pos + 1, size, '\n'))
+        lineStarts.push_back(static_cast<uint32_t>(pos + 1));
+}
+SourceLocation SourceMap::locate(size_t position) const {
+    if (lineStarts.empty())
+        return {};
+    position = std::min(position, size);
+    auto next = std::upper_bound(lineStarts.begin(), lineStarts.end(), position);
+    size_t line = next - lineStarts.begin();
+    int column = static_cast<int>(position - lineStarts[line - 1]) + 1;
+    if (line == 1)
+        column += origin.column - 1;
+    return {static_cast<int>(line) + origin.line - 1, column};
+}
+int SourceMap::line(size_t position) const {
+    return locate(position).line;
+}
+size_t SourceMap::lineCount() const {
+    return lineStarts.size();
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include "scanner.h"
+#include <cstdint>
+#include <string_view>
+#include <vector>
+struct SourceLocation {
+    int line = -1;
+    int column = -1;
+};
+// Line-start offsets for one script, built once alongside its tokens.
+// Line and column lookups binary-search the table instead of rescanning
+// the source from the first byte. A map can also describe a window of a
+// larger script that starts at `origin`.
+class SourceMap {
+public:
+    SourceMap() = default;
+    SourceMap(std::string_view source, const ScanKernels& scan, SourceLocation origin = {1, 1});
+    SourceLocation locate(size_t position) const;
+    int line(size_t position) const;
+    size_t lineCount() const;
+private:
+    std::vector<uint32_t> lineStarts;
+    size_t size = 0;
+    SourceLocation origin;
+};
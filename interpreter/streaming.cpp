@@ -0,0 +1,76 @@
+#include "streaming.h"
+#include "astbuilder.h"
+#include "ErrorHandler.h"
+#include <algorithm>
+StreamingRunner::StreamingRunner(std::istream& input, OutputChannel& output, size_t chunkSize)
+    : input(input), chunkSize(chunkSize), session(output) {}
+size_t StreamingRunner::peakBuffered() const {
+    return peak;
+}
+void StreamingRunner::readMore() {
+    size_t want = std::max(chunkSize, pending.size());
+    size_t start = pending.size();
+    pending.resize(start + want);
+    input.read(&pending[start], static_cast<std::streamsize>(want));
+    pending.resize(start + static_cast<size_t>(input.gcount()));
+    finished = !input;
+    peak = std::max(peak, pending.size());
+}
+void StreamingRunner::run() {
+    while (!finished) {
+        readMore();
+        while (executeBuffered()) {}
+    }
+}
+// Parses and runs every complete top-level item in the buffered text and
+// drops the text it consumed. Returns false when more input is needed.
+bool StreamingRunner::executeBuffered() {
+    size_t limit = pending.size();
+    if (!finished) {
+        // Only hand whole lines to the lexer; a token never spans a newline
+        // unless it is a string or comment, which report themselves as
+        // incomplete.
+        size_t lastNewline = pending.rfind('\n');
+        if (lastNewline == std::string::npos)
+            return false;
+        limit = lastNewline + 1;
+    }
+    std::string_view window(pending.data(), limit);
+    std::unique_ptr<Lexer> lexer;
+    try {
+        lexer = std::make_unique<Lexer>(window, ScanMode::AUTO, origin);
+    } catch (const IncompleteInputError&) {
+        if (finished)
+            throw;
+        return false;
+    }
+    AstBuilder builder(*lexer);
+    Program batch;
+    size_t consumed = 0;
+    while (true) {
+        size_t before = batch.statements.size();
+        try {
+            if (!builder.buildNext(batch)) {
+                consumed = builder.position();
+                break;
+            }
+        } catch (const IncompleteInputError&) {
+            if (finished)
+                throw;
+            break;
+        }
+        // An if or do-while that ends the window may still continue with
+        // elif/else or its trailing while in the next chunk.
+        if (builder.atEnd() && !finished && batch.statements.size() > before) {
+            batch.statements.pop_back();
+            break;
+        }
+        consumed = builder.position();
+    }
+    if (consumed == 0)
+        return false;
+    session.execute(batch, *lexer);
+    origin = lexer->getLocation(consumed);
+    pending.erase(0, consumed);
+    return !pending.empty();
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include "output.h"
+#include "session.h"
+#include <istream>
+#include <string>
+// Executes a script while it is still being read. Input arrives in chunks;
+// every complete top-level statement in the buffered text is parsed,
+// resolved and run, then its text is dropped. Function definitions outlive
+// their chunk as AST, together with that chunk's line table, so peak
+// memory follows the largest unexecuted statement rather than file size.
+//
+// Because globals are discovered as the script streams by, a function
+// only assigns to a global that was assigned at top level before the
+// function's definition finished streaming in.
+class StreamingRunner {
+public:
+    static constexpr size_t CHUNK_SIZE = 1 << 20;
+    StreamingRunner(std::istream& input, OutputChannel& output = OutputChannel::standard(), size_t chunkSize = CHUNK_SIZE);
+    void run();
+    size_t peakBuffered() const;
+private:
+    std::istream& input;
+    size_t chunkSize;
+    Session session;
+    std::string pending;
+    SourceLocation origin{1, 1};
+    bool finished = false;
+    size_t peak = 0;
+    void readMore();
+    bool executeBuffered();
+};
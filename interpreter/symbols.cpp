@@ -0,0 +1,41 @@
+#include "symbols.h"
+#include <stdexcept>
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable table;
+    return table;
+}
+SymbolTable::~SymbolTable() {
+    for (auto& block : blocks)
+        delete[] block.load();
+}
+// Each thread remembers the symbols it has looked up, so lexing takes the
+// lock only for text the thread has not seen before.
+static thread_local std::unordered_map<std::string_view, Symbol> seen;
+Symbol SymbolTable::intern(std::string_view text) {
+    auto known = seen.find(text);
+    if (known != seen.end())
+        return known->second;
+    SymbolTable& table = instance();
+    std::lock_guard<std::mutex> guard(table.lock);
+    auto found = table.index.find(text);
+    if (found != table.index.end()) {
+        seen.emplace(found->first, found->second);
+        return found->second;
+    }
+    size_t next = table.count.load(std::memory_order_relaxed);
+    if (next == BLOCK_SIZE * MAX_BLOCKS)
+        throw std::length_error("Too many distinct identifiers and strings");
+    std::atomic<Entry*>& block = table.blocks[next / BLOCK_SIZE];
+    if (next % BLOCK_SIZE == 0)
+        block.store(new Entry[BLOCK_SIZE], std::memory_order_release);
+    Entry& entry = block.load(std::memory_order_relaxed)[next % BLOCK_SIZE];
+    entry.name.assign(text);
+    entry.string = Value::immortal(text);
+    table.index.emplace(entry.name, static_cast<Symbol>(next));
+    seen.emplace(entry.name, static_cast<Symbol>(next));
+    table.count.store(next + 1, std::memory_order_release);
+    return static_cast<Symbol>(next);
+}
+size_t SymbolTable::size() {
+    return instance().count.load(std::memory_order_acquire);
+}
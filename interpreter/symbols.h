@@ -0,0 +1,39 @@
+#pragma once
+#include "value.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+using Symbol = uint32_t;
+// Process-wide interner for identifiers and string literals. Symbols are
+// assigned during lexing, so execution only ever reads the table. Scripts
+// may be lexed on several threads at once: intern() takes a lock, while
+// entries live in fixed blocks that never move, so reads need none.
+class SymbolTable {
+public:
+    static constexpr size_t BLOCK_SIZE = 1 << 12;
+    static constexpr size_t MAX_BLOCKS = 1 << 12;
+    static Symbol intern(std::string_view text);
+    static const std::string& name(Symbol symbol) { return entry(symbol).name; }
+    static const Value& string(Symbol symbol) { return entry(symbol).string; }
+    static size_t size();
+private:
+    struct Entry {
+        std::string name;
+        Value string;
+    };
+    std::array<std::atomic<Entry*>, MAX_BLOCKS> blocks{};
+    std::atomic<size_t> count{0};
+    std::mutex lock;
+    std::unordered_map<std::string_view, Symbol> index;
+    static SymbolTable& instance();
+    static const Entry& entry(Symbol symbol) {
+        return instance().blocks[symbol / BLOCK_SIZE].load(std::memory_order_acquire)[symbol % BLOCK_SIZE];
+    }
+    SymbolTable() = default;
+    ~SymbolTable();
+};
@@ -0,0 +1,149 @@
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+static size_t configuredWorkers = 0;
+// Set on the pool's own threads, so a task that submits a nested batch
+// keeps its worker number.
+static thread_local const ThreadPool* currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+namespace {
+struct Range {
+    std::mutex lock;
+    size_t next = 0;
+    size_t end = 0;
+};
+}
+struct ThreadPool::Batch {
+    const std::function<void(size_t, size_t)>* task;
+    size_t workers;
+    std::unique_ptr<Range[]> ranges;
+    std::atomic<size_t> remaining;
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex errorLock;
+    // Pool threads inside execute(); guarded by the pool's lock.
+    size_t attached = 0;
+    Batch(const std::function<void(size_t, size_t)>& task, size_t count, size_t workers)
+        : task(&task), workers(workers), ranges(new Range[workers]), remaining(count) {
+        for (size_t i = 0; i < workers; ++i) {
+            ranges[i].next = count * i / workers;
+            ranges[i].end = count * (i + 1) / workers;
+        }
+    }
+    // The next index of the worker's own range, or the first of the back
+    // half it steals from the next range that still has work.
+    bool take(size_t worker, size_t& index) {
+        Range& own = ranges[worker];
+        {
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (own.next < own.end) {
+                index = own.next++;
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < workers; ++offset) {
+            Range& victim = ranges[(worker + offset) % workers];
+            size_t first, last;
+            {
+                std::lock_guard<std::mutex> guard(victim.lock);
+                size_t left = victim.end - victim.next;
+                if (left == 0)
+                    continue;
+                last = victim.end;
+                victim.end -= (left + 1) / 2;
+                first = victim.end;
+            }
+            index = first;
+            std::lock_guard<std::mutex> guard(own.lock);
+            own.next = first + 1;
+            own.end = last;
+            return true;
+        }
+        return false;
+    }
+};
+void ThreadPool::setThreads(size_t count) {
+    configuredWorkers = count;
+}
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool(configuredWorkers ? configuredWorkers : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+ThreadPool::ThreadPool(size_t workers) {
+    for (size_t i = 0; i + 1 < workers; ++i)
+        threads.emplace_back(&ThreadPool::work, this, i);
+}
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+}
+void ThreadPool::run(size_t count, const std::function<void(size_t, size_t)>& task) {
+    if (count == 0)
+        return;
+    size_t worker = currentPool == this ? currentWorker : threads.size();
+    Batch batch(task, count, workers());
+    if (!threads.empty()) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            batches.push_back(&batch);
+        }
+        wake.notify_all();
+    }
+    execute(batch, worker);
+    if (!threads.empty()) {
+        std::unique_lock<std::mutex> guard(lock);
+        finished.wait(guard, [&] { return batch.remaining == 0 && batch.attached == 0; });
+        auto found = std::find(batches.begin(), batches.end(), &batch);
+        if (found != batches.end())
+            batches.erase(found);
+    }
+    if (batch.error)
+        std::rethrow_exception(batch.error);
+}
+void ThreadPool::execute(Batch& batch, size_t worker) {
+    size_t index;
+    while (batch.take(worker, index)) {
+        if (!batch.failed) {
+            try {
+                (*batch.task)(index, worker);
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(batch.errorLock);
+                if (!batch.error)
+                    batch.error = std::current_exception();
+                batch.failed = true;
+            }
+        }
+        if (--batch.remaining == 0) {
+            std::lock_guard<std::mutex> guard(lock);
+            finished.notify_all();
+        }
+    }
+}
+// Pool threads join the most recent batch; once nothing is left to take
+// from it, it is no longer offered.
+void ThreadPool::work(size_t worker) {
+    currentPool = this;
+    currentWorker = worker;
+    std::unique_lock<std::mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [&] { return stopping || !batches.empty(); });
+        if (stopping)
+            return;
+        Batch* batch = batches.back();
+        ++batch->attached;
+        guard.unlock();
+        execute(*batch, worker);
+        guard.lock();
+        --batch->attached;
+        auto found = std::find(batches.begin(), batches.end(), batch);
+        if (found != batches.end())
+            batches.erase(found);
+        finished.notify_all();
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+// Work-stealing pool shared by everything that runs in parallel. A batch of
+// tasks is split evenly between the pool's threads and the thread that
+// submits it; a thread that runs out of work steals the back half of
+// another thread's range. The submitting thread works on its own batch too,
+// so a task may submit a nested batch without starving the pool.
+class ThreadPool {
+public:
+    // Threads working on a batch, the submitting one included; 0 means one
+    // per core and 1 runs every batch on the submitting thread alone.
+    static void setThreads(size_t count);
+    static ThreadPool& shared();
+    explicit ThreadPool(size_t workers);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    size_t workers() const { return threads.size() + 1; }
+    // Calls task(index, worker) for every index in [0, count) and returns
+    // once all calls have finished. `worker` is below workers() and no two
+    // threads working on the same batch share it, so it can pick per-thread
+    // state. The first exception a task throws is rethrown here, and the
+    // tasks nobody started by then are skipped.
+    void run(size_t count, const std::function<void(size_t, size_t)>& task);
+private:
+    struct Batch;
+    std::vector<std::thread> threads;
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::vector<Batch*> batches;
+    bool stopping = false;
+    void work(size_t worker);
+    void execute(Batch& batch, size_t worker);
+};
@@ -0,0 +1,62 @@
+#include "tiering.h"
+#include <map>
+#include <mutex>
+#include <tuple>
+static uint64_t configuredThreshold = Tiering::DEFAULT_THRESHOLD;
+struct FunctionTotals {
+    uint64_t calls = 0;
+    uint64_t iterations = 0;
+    uint64_t promotedAt = 0;
+    std::string tier;
+};
+static std::mutex totalsMutex;
+static std::map<std::pair<std::string, std::string>, FunctionTotals>& functionTotals() {
+    static std::map<std::pair<std::string, std::string>, FunctionTotals> byFunction;
+    return byFunction;
+}
+static std::map<std::tuple<std::string, std::string, int>, uint64_t>& loopTotals() {
+    static std::map<std::tuple<std::string, std::string, int>, uint64_t> byLoop;
+    return byLoop;
+}
+void Tiering::setThreshold(uint64_t hotness) {
+    configuredThreshold = hotness;
+}
+uint64_t Tiering::threshold() {
+    return configuredThreshold;
+}
+// A function recorded again (a later run, or a session that redefined
+// functions) keeps its first tier-up and the most recent decision.
+void Tiering::recordFunction(const char* engine, const std::string& name, uint64_t calls, uint64_t iterations,
+                             uint64_t promotedAt, const std::string& tier) {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    FunctionTotals& total = functionTotals()[{engine, name}];
+    total.calls += calls;
+    total.iterations += iterations;
+    if (!total.promotedAt)
+        total.promotedAt = promotedAt;
+    if (total.tier.empty() || promotedAt)
+        total.tier = tier;
+}
+void Tiering::recordLoop(const char* engine, const std::string& function, int line, uint64_t iterations) {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    loopTotals()[{engine, function, line}] += iterations;
+}
+void Tiering::report(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    if (functionTotals().empty() && loopTotals().empty())
+        return;
+    if (enabled())
+        out << "Tier-up threshold: " << threshold() << "\n";
+    else
+        out << "Tier-up: off\n";
+    for (const auto& [key, total] : functionTotals()) {
+        out << "Function " << key.second << " (" << key.first << "): " << total.calls << " calls, "
+            << total.iterations << " loop iterations, " << total.tier;
+        if (total.promotedAt)
+            out << " at hotness " << total.promotedAt;
+        out << "\n";
+    }
+    for (const auto& [key, iterations] : loopTotals())
+        out << "Loop at line " << std::get<2>(key) << " in " << std::get<1>(key) << " (" << std::get<0>(key) << "): "
+            << iterations << " iterations\n";
+}
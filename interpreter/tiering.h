@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+// Tier-up policy shared by the engines. Each engine counts calls per
+// function and iterations per loop; a function's hotness is its calls plus
+// the iterations of the loops inside it, and a function at or above the
+// threshold is promoted from the baseline tier (the ast walker or the vm)
+// to native code (see Jit). Top-level code touches globals and always stays
+// on the baseline tier. Counts and decisions are added to process-wide
+// totals printed by --stats.
+class Tiering {
+public:
+    static constexpr uint64_t DEFAULT_THRESHOLD = 1000;
+    // 0 keeps every function on the baseline tier for the run.
+    static void setThreshold(uint64_t hotness);
+    static uint64_t threshold();
+    static bool enabled() { return threshold() != 0; }
+    // `tier` is where the function ended up, e.g. "native" or why it
+    // stayed behind; `promotedAt` is its hotness at tier-up, 0 if never.
+    static void recordFunction(const char* engine, const std::string& name, uint64_t calls, uint64_t iterations,
+                               uint64_t promotedAt, const std::string& tier);
+    static void recordLoop(const char* engine, const std::string& function, int line, uint64_t iterations);
+    static void report(std::ostream& out);
+};
@@ -0,0 +1,36 @@
+#include "value.h"
+#include <cstring>
+#include <new>
+Value::StringData* Value::allocate(std::string_view text, uint32_t refs) {
+    StringData* data = static_cast<StringData*>(::operator new(sizeof(StringData) + text.size() + 1));
+    data->refs = refs;
+    data->size = static_cast<uint32_t>(text.size());
+    std::memcpy(data->chars(), text.data(), text.size());
+    data->chars()[text.size()] = '\0';
+    return data;
+}
+Value::Value(std::string_view text) : tag(STRING) {
+    payload.string = allocate(text, 1);
+}
+Value Value::immortal(std::string_view text) {
+    Value value;
+    value.tag = STRING;
+    value.payload.string = allocate(text, IMMORTAL);
+    return value;
+}
+Value Value::isolated() const {
+    if (tag == STRING && payload.string->refs != IMMORTAL)
+        return Value(asString());
+    return *this;
+}
+void Value::releaseString() {
+    if (payload.string->refs != IMMORTAL && --payload.string->refs == 0)
+        ::operator delete(payload.string);
+}
+bool Value::operator==(const Value& other) const {
+    if (tag != other.tag)
+        return false;
+    if (tag == INT)
+        return payload.integer == other.payload.integer;
+    return payload.string == other.payload.string || asString() == other.asString();
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+// 16-byte tagged value. 64-bit integers are stored inline; strings point at an
+// immutable, reference-counted payload, so copying a value never copies
+// string bytes. Interned literals are immortal and skip the count entirely.
+class Value {
+public:
+    enum Type : uint8_t {
+        INT,
+        STRING
+    };
+    Value() noexcept : tag(INT) { payload.integer = 0; }
+    Value(int64_t integer) noexcept : tag(INT) { payload.integer = integer; }
+    Value(std::string_view text);
+    Value(const std::string& text) : Value(std::string_view(text)) {}
+    Value(const Value& other) noexcept : tag(other.tag), payload(other.payload) { retain(); }
+    Value(Value&& other) noexcept : tag(other.tag), payload(other.payload) { other.tag = INT; }
+    ~Value() { release(); }
+    Value& operator=(const Value& other) noexcept {
+        other.retain();
+        release();
+        tag = other.tag;
+        payload = other.payload;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            tag = other.tag;
+            payload = other.payload;
+            other.tag = INT;
+        }
+        return *this;
+    }
+    Value& operator=(int64_t integer) noexcept {
+        release();
+        tag = INT;
+        payload.integer = integer;
+        return *this;
+    }
+    static Value immortal(std::string_view text);
+    // A copy sharing no reference count with this value, which another
+    // thread may then copy and release freely.
+    Value isolated() const;
+    Type type() const { return tag; }
+    bool isInt() const { return tag == INT; }
+    bool isString() const { return tag == STRING; }
+    int64_t asInt() const { return payload.integer; }
+    std::string_view asString() const { return {payload.string->chars(), payload.string->size}; }
+    bool operator==(const Value& other) const;
+    bool operator!=(const Value& other) const { return !(*this == other); }
+private:
+    struct StringData {
+        uint32_t refs;
+        uint32_t size;
+        char* chars() { return reinterpret_cast<char*>(this + 1); }
+    };
+    static constexpr uint32_t IMMORTAL = UINT32_MAX;
+    Type tag;
+    union {
+        int64_t integer;
+        StringData* string;
+    } payload;
+    static StringData* allocate(std::string_view text, uint32_t refs);
+    void retain() const {
+        if (tag == STRING && payload.string->refs != IMMORTAL)
+            ++payload.string->refs;
+    }
+    void release() {
+        if (tag == STRING)
+            releaseString();
+    }
+    void releaseString();
+};
+static_assert(sizeof(Value) == 16, "Value should stay two words");
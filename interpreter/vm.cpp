@@ -0,0 +1,536 @@
+#include "vm.h"
+#include "ErrorHandler.h"
+#include "arithmetic.h"
+#include "parallel.h"
+#include "tiering.h"
+#include <algorithm>
+#include <map>
+#if defined(__GNUC__) || defined(__clang__)
+#define PDEV_COMPUTED_GOTO 1
+#endif
+VM::VM(const CompiledProgram& program, const Lexer& lexer, OutputChannel& output)
+    : VM(program, lexer.getSourceMap(), output) {}
+VM::VM(const CompiledProgram& program, const SourceMap& sourceMap, OutputChannel& output)
+    : program(program), sourceMap(sourceMap), output(output), globals(program.globals.size()), globalDefined(program.globals.size(), 0) {
+    if (Jit::enabled())
+        jit = std::make_unique<Jit>(program);
+    countLoops();
+    for (const HostCall& call : program.hostCalls) {
+        const HostFunctions::Entry* host = HostFunctions::find(call.name);
+        hosts.push_back(host && host->arity == static_cast<size_t>(call.arity) ? host : nullptr);
+    }
+}
+// Workers start from isolated copies of the frame at `base` and of the
+// globals of the vm running the loop, which waits for them meanwhile.
+VM::VM(const VM& parent, size_t base, const ParallelLoop& loop, OutputChannel& output)
+    : program(parent.program), sourceMap(parent.sourceMap), output(output), globalDefined(parent.globalDefined), hosts(parent.hosts) {
+    const int frameSize = program.functions[loop.body].frameSize;
+    stack.reserve(frameSize);
+    for (int i = 0; i < frameSize; ++i)
+        stack.push_back(parent.stack[base + i].isolated());
+    globals.reserve(parent.globals.size());
+    for (const Value& value : parent.globals)
+        globals.push_back(value.isolated());
+    for (char& flags : globalDefined)
+        flags |= READ_ONLY;
+    for (const auto& reduction : loop.reductions) {
+        if (reduction.global)
+            globalDefined[reduction.index] &= ~READ_ONLY;
+    }
+    if (Jit::enabled())
+        jit = std::make_unique<Jit>(program);
+    countLoops();
+}
+void VM::countLoops() {
+    backEdgeCounts.resize(program.functions.size());
+    for (size_t i = 0; i < program.functions.size(); ++i)
+        backEdgeCounts[i].assign(program.functions[i].code.size(), 0);
+}
+// Back-edges of one loop (its closing jump and any `continue`) share a
+// target. A loop's count is theirs added up, and it is reported at the
+// line of the closing jump. A parallel for is counted at its PARALLEL_FOR,
+// whose operand names the loop rather than a target.
+static uint64_t countedLoops(const CompiledFunction& function, const std::vector<uint64_t>& counts,
+                             std::map<size_t, std::pair<size_t, uint64_t>>& loops) {
+    uint64_t total = 0;
+    for (size_t at = 0; at < counts.size(); ++at) {
+        if (!counts[at])
+            continue;
+        auto& loop = loops[function.code[at].op == OpCode::PARALLEL_FOR ? at : static_cast<size_t>(function.code[at].arg)];
+        loop.first = std::max(loop.first, at);
+        loop.second += counts[at];
+        total += counts[at];
+    }
+    return total;
+}
+// Calls and hotness are only tracked by the jit; loops are counted by the
+// vm itself. Bodies of parallel loops only show up as loops.
+VM::~VM() {
+    for (size_t i = 0; i < program.functions.size(); ++i) {
+        const CompiledFunction& function = program.functions[i];
+        std::map<size_t, std::pair<size_t, uint64_t>> loops;
+        uint64_t iterations = countedLoops(function, backEdgeCounts[i], loops);
+        for (const auto& [target, loop] : loops)
+            Tiering::recordLoop("vm", function.name, sourceMap.locate(function.positions[loop.first]).line, loop.second);
+        int index = static_cast<int>(i);
+        if (jit && i > 0 && i < program.functions.size() - program.parallelLoops.size() && (jit->calls(index) || iterations))
+            Tiering::recordFunction("vm", function.name, jit->calls(index), iterations, jit->promotedAt(index), jit->tier(index));
+    }
+}
+void VM::reserveStack(size_t size) {
+    if (stack.size() < size)
+        stack.resize(std::max(size, stack.size() * 2));
+}
+MemoTable& VM::memoTable(int function) {
+    if (memoTables.empty())
+        memoTables.resize(program.functions.size());
+    auto& table = memoTables[function];
+    if (!table)
+        table = std::make_unique<MemoTable>(program.functions[function].name);
+    return *table;
+}
+// Called every Jit::LOOP_SAMPLE back-edges. The loop that happens to close
+// the sample is charged for all of them in the jit's hotness, which is
+// close enough for finding hot loops; the stats dump uses exact counts.
+bool VM::enterHotLoop(const Instruction* backEdge, const Value* locals, const Value* sp, int64_t& result) {
+    const Frame& frame = frames.back();
+    if (!jit)
+        return false;
+    int function = static_cast<int>(frame.function - program.functions.data());
+    return jit->tryLoop(function, backEdge - frame.function->code.data(), locals, sp - locals, result);
+}
+void VM::error(const std::string& message, const Frame& frame, const Instruction* ip) const {
+    size_t offset = ip - frame.function->code.data();
+    ErrorHandler::throwError(message, sourceMap.locate(frame.function->positions[offset]));
+}
+void VM::error(const std::string& message, size_t position) const {
+    ErrorHandler::throwError(message, sourceMap.locate(position));
+}
+static inline bool compareInts(OpCode compare, int64_t lhs, int64_t rhs) {
+    switch (compare) {
+        case OpCode::LT: return lhs < rhs;
+        case OpCode::LE: return lhs <= rhs;
+        case OpCode::GT: return lhs > rhs;
+        case OpCode::GE: return lhs >= rhs;
+        case OpCode::NE: return lhs != rhs;
+        default: return false;
+    }
+}
+static ParallelFor::Until parallelUntil(OpCode compare) {
+    switch (compare) {
+        case OpCode::LE: return ParallelFor::Until::LESS_EQUAL;
+        case OpCode::GT: return ParallelFor::Until::GREATER;
+        case OpCode::GE: return ParallelFor::Until::GREATER_EQUAL;
+        case OpCode::NE: return ParallelFor::Until::NOT_EQUAL;
+        default: return ParallelFor::Until::LESS;
+    }
+}
+static ParallelFor::Reduce parallelReduce(OpCode op) {
+    return op == OpCode::MUL ? ParallelFor::Reduce::MULTIPLY : ParallelFor::Reduce::ADD;
+}
+// PARALLEL_FOR checked the counter and the bound. The iterations run on
+// workers, each over its own copy of the frame and globals, and the
+// reductions are combined back into this frame afterwards.
+void VM::runParallel(const Instruction* ip, size_t base, int64_t bound) {
+    const ParallelLoop& loop = program.parallelLoops[ip->arg];
+    const int64_t start = stack[base + ip->slot].asInt();
+    uint64_t count;
+    if (!ParallelFor::iterations(parallelUntil(ip->compare), start, bound, loop.step, count))
+        error("parallel for never reaches its bound", frames.back(), ip);
+    std::vector<ParallelFor::Reduce> ops;
+    for (const auto& reduction : loop.reductions) {
+        if (reduction.global && !(globalDefined[reduction.index] & DEFINED))
+            error("Undefined variable: " + reduction.name, reduction.position);
+        const Value& var = reduction.global ? globals[reduction.index] : stack[base + reduction.index];
+        if (!var.isInt())
+            error("Reduction variable is not an integer: " + reduction.name, reduction.position);
+        ops.push_back(parallelReduce(reduction.op));
+    }
+    const Frame& frame = frames.back();
+    backEdgeCounts[frame.function - program.functions.data()][ip - frame.function->code.data()] += count;
+    ParallelFor parallel(output, loop.unordered, ops);
+    std::vector<std::unique_ptr<VM>> workers(parallel.workers());
+    const uint16_t slot = ip->slot;
+    parallel.run(start, loop.step, count, [&](size_t index, int64_t first, uint64_t length, int64_t* partials) {
+        std::unique_ptr<VM>& engine = workers[index];
+        if (!engine)
+            engine.reset(new VM(*this, base, loop, parallel.output(index)));
+        try {
+            engine->runChunk(loop, slot, first, length, partials);
+        } catch (...) {
+            engine.reset();
+            throw;
+        }
+    });
+    for (size_t r = 0; r < loop.reductions.size(); ++r) {
+        const auto& reduction = loop.reductions[r];
+        Value& var = reduction.global ? globals[reduction.index] : stack[base + reduction.index];
+        int64_t result;
+        bool exact = ParallelFor::combine(ops[r], var.asInt(), parallel.results()[r], result) && parallel.exact(r);
+        if (!exact && Arithmetic::trapOverflow())
+            error("Integer overflow", reduction.position);
+        var = result;
+    }
+}
+void VM::runChunk(const ParallelLoop& loop, uint16_t slot, int64_t first, uint64_t count, int64_t* partials) {
+    for (const auto& reduction : loop.reductions) {
+        int64_t identity = ParallelFor::identity(parallelReduce(reduction.op));
+        if (reduction.global) {
+            globals[reduction.index] = identity;
+            globalDefined[reduction.index] |= DEFINED;
+        } else {
+            stack[reduction.index] = identity;
+        }
+    }
+    const CompiledFunction& body = program.functions[loop.body];
+    uint64_t counter = static_cast<uint64_t>(first);
+    for (uint64_t i = 0; i < count; ++i, counter += static_cast<uint64_t>(static_cast<int64_t>(loop.step))) {
+        stack[slot] = static_cast<int64_t>(counter);
+        execute(body);
+    }
+    for (size_t r = 0; r < loop.reductions.size(); ++r) {
+        const auto& reduction = loop.reductions[r];
+        const Value& var = reduction.global ? globals[reduction.index] : stack[reduction.index];
+        if (!var.isInt())
+            error("Reduction variable is not an integer: " + reduction.name, reduction.position);
+        partials[r] = var.asInt();
+    }
+}
+void VM::run() {
+    execute(program.functions[0]);
+}
+// Runs `entry` in a frame at the bottom of the stack, keeping whatever the
+// frame's slots already hold.
+void VM::execute(const CompiledFunction& entry) {
+    const CompiledFunction* function = &entry;
+    frames.clear();
+    memoKeys.clear();
+    frames.push_back({function, nullptr, 0});
+    reserveStack(std::max<size_t>(1024, function->frameSize + function->maxStack));
+    Value* locals = stack.data();
+    Value* sp = locals + function->frameSize;
+    const Instruction* code = function->code.data();
+    const Instruction* ip = code;
+    uint64_t* edgeCounts = backEdgeCounts[function - program.functions.data()].data();
+    uint32_t loopBudget = Jit::LOOP_SAMPLE;
+    const bool trapOverflow = Arithmetic::trapOverflow();
+    // Stands in for the rest of a call that finished in native code.
+    static const Instruction nativeReturn{OpCode::RETURN};
+#define VM_ERROR(message) error(message, frames.back(), ip)
+#define VM_INT(slot) \
+    if (!(slot).isInt()) VM_ERROR("Expected an integer value")
+#define VM_OVERFLOW(exact) \
+    if (!(exact) && trapOverflow) VM_ERROR("Integer overflow")
+#define VM_ARITHMETIC(operation) { \
+        int64_t result; \
+        VM_OVERFLOW(Arithmetic::operation(sp[-2].asInt(), sp[-1].asInt(), result)); \
+        --sp; \
+        sp[-1] = result; \
+        ++ip; \
+        DISPATCH(); \
+    }
+#define VM_COMPARE(op) { \
+        bool holds = sp[-2].asInt() op sp[-1].asInt(); \
+        --sp; \
+        sp[-1] = holds ? 1 : 0; \
+        ++ip; \
+        DISPATCH(); \
+    }
+#define VM_OPERANDS() \
+    VM_INT(sp[-2]); \
+    VM_INT(sp[-1])
+#define VM_BACK_EDGE(target) { \
+        const Instruction* edge = ip; \
+        ++edgeCounts[edge - code]; \
+        ip = (target); \
+        int64_t nativeResult; \
+        if (--loopBudget == 0 && (loopBudget = Jit::LOOP_SAMPLE, enterHotLoop(edge, locals, sp, nativeResult))) { \
+            size_t top = sp - stack.data(); \
+            reserveStack(top + 1); \
+            sp = stack.data() + top; \
+            *sp++ = nativeResult; \
+            ip = &nativeReturn; \
+        } \
+        DISPATCH(); \
+    }
+#ifdef PDEV_COMPUTED_GOTO
+    static void* const dispatchTable[] = {
+#define PDEV_OPCODE_LABEL(name) &&op_##name,
+        PDEV_OPCODES(PDEV_OPCODE_LABEL)
+#undef PDEV_OPCODE_LABEL
+    };
+#define DISPATCH() goto *dispatchTable[static_cast<uint8_t>(ip->op)]
+#define TARGET(name) op_##name
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define TARGET(name) case OpCode::name
+dispatch:
+    switch (ip->op) {
+#endif
+    TARGET(PUSH_INT):
+        *sp++ = ip->arg;
+        ++ip;
+        DISPATCH();
+    TARGET(PUSH_CONST):
+        *sp++ = program.constants[ip->arg];
+        ++ip;
+        DISPATCH();
+    TARGET(PUSH_STRING):
+        *sp++ = program.strings[ip->arg];
+        ++ip;
+        DISPATCH();
+    TARGET(POP):
+        --sp;
+        ++ip;
+        DISPATCH();
+    TARGET(LOAD_LOCAL):
+        *sp++ = locals[ip->arg];
+        ++ip;
+        DISPATCH();
+    TARGET(STORE_LOCAL):
+        locals[ip->arg] = std::move(*--sp);
+        ++ip;
+        DISPATCH();
+    TARGET(LOAD_GLOBAL):
+        if (!(globalDefined[ip->arg] & DEFINED))
+            VM_ERROR("Undefined variable: " + SymbolTable::name(program.globals[ip->arg]));
+        *sp++ = globals[ip->arg];
+        ++ip;
+        DISPATCH();
+    TARGET(STORE_GLOBAL):
+        if (globalDefined[ip->arg] & READ_ONLY)
+            VM_ERROR("Cannot assign global variable inside parallel for: " + SymbolTable::name(program.globals[ip->arg]));
+        globals[ip->arg] = std::move(*--sp);
+        globalDefined[ip->arg] |= DEFINED;
+        ++ip;
+        DISPATCH();
+    TARGET(ADD):
+        VM_OPERANDS();
+        VM_ARITHMETIC(add)
+    TARGET(SUB):
+        VM_OPERANDS();
+        VM_ARITHMETIC(subtract)
+    TARGET(MUL):
+        VM_OPERANDS();
+        VM_ARITHMETIC(multiply)
+    TARGET(DIV):
+        VM_INT(sp[-1]);
+        if (sp[-1].asInt() == 0)
+            VM_ERROR("Division by zero");
+        VM_INT(sp[-2]);
+        VM_ARITHMETIC(divide)
+    TARGET(ADD_INT): VM_ARITHMETIC(add)
+    TARGET(SUB_INT): VM_ARITHMETIC(subtract)
+    TARGET(MUL_INT): VM_ARITHMETIC(multiply)
+    TARGET(DIV_INT):
+        if (sp[-1].asInt() == 0)
+            VM_ERROR("Division by zero");
+        VM_ARITHMETIC(divide)
+    TARGET(NEG): {
+        VM_INT(sp[-1]);
+        int64_t result;
+        VM_OVERFLOW(Arithmetic::negate(sp[-1].asInt(), result));
+        sp[-1] = result;
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(CHECK_INT):
+        VM_INT(sp[-1]);
+        ++ip;
+        DISPATCH();
+    TARGET(EQ): {
+        bool equal = sp[-2] == sp[-1];
+        --sp;
+        sp[-1] = equal ? 1 : 0;
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(NE): {
+        bool equal = sp[-2] == sp[-1];
+        --sp;
+        sp[-1] = equal ? 0 : 1;
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LT):
+        VM_OPERANDS();
+        VM_COMPARE(<)
+    TARGET(LE):
+        VM_OPERANDS();
+        VM_COMPARE(<=)
+    TARGET(GT):
+        VM_OPERANDS();
+        VM_COMPARE(>)
+    TARGET(GE):
+        VM_OPERANDS();
+        VM_COMPARE(>=)
+    TARGET(EQ_INT): VM_COMPARE(==)
+    TARGET(NE_INT): VM_COMPARE(!=)
+    TARGET(LT_INT): VM_COMPARE(<)
+    TARGET(LE_INT): VM_COMPARE(<=)
+    TARGET(GT_INT): VM_COMPARE(>)
+    TARGET(GE_INT): VM_COMPARE(>=)
+    TARGET(JUMP):
+        if (ip->arg <= ip - code)
+            VM_BACK_EDGE(code + ip->arg)
+        ip = code + ip->arg;
+        DISPATCH();
+    TARGET(JUMP_IF_FALSE): {
+        VM_INT(sp[-1]);
+        --sp;
+        ip = sp->asInt() ? ip + 1 : code + ip->arg;
+        DISPATCH();
+    }
+    TARGET(JUMP_IF_TRUE): {
+        VM_INT(sp[-1]);
+        --sp;
+        if (!sp->asInt()) {
+            // A do-while's last test counts too, so its count is the
+            // number of iterations.
+            if (ip->arg <= ip - code)
+                ++edgeCounts[ip - code];
+            ++ip;
+            DISPATCH();
+        }
+        if (ip->arg <= ip - code)
+            VM_BACK_EDGE(code + ip->arg)
+        ip = code + ip->arg;
+        DISPATCH();
+    }
+    TARGET(INC_LOCAL): {
+        VM_INT(locals[ip->slot]);
+        int64_t result;
+        VM_OVERFLOW(Arithmetic::add(locals[ip->slot].asInt(), ip->arg, result));
+        locals[ip->slot] = result;
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(LOOP_ENTER):
+        VM_INT(locals[ip->slot]);
+        VM_INT(sp[-1]);
+        if (!compareInts(ip->compare, locals[ip->slot].asInt(), sp[-1].asInt())) {
+            ip = code + ip->arg;
+            DISPATCH();
+        }
+        // Charged to the LOOP_NEXT just before the exit, so the loop's
+        // count is the number of iterations rather than of back-edges.
+        ++edgeCounts[ip->arg - 1];
+        ++ip;
+        DISPATCH();
+    TARGET(LOOP_NEXT):
+        // INC_LOCAL just checked the counter and LOOP_ENTER the bound.
+        if (!compareInts(ip->compare, locals[ip->slot].asInt(), sp[-1].asInt())) {
+            ++ip;
+            DISPATCH();
+        }
+        VM_BACK_EDGE(code + ip->arg)
+    TARGET(PARALLEL_FOR):
+        VM_INT(locals[ip->slot]);
+        VM_INT(sp[-1]);
+        runParallel(ip, locals - stack.data(), sp[-1].asInt());
+        --sp;
+        ++ip;
+        DISPATCH();
+    TARGET(CALL): {
+        const CompiledFunction* callee = &program.functions[ip->arg];
+        MemoTable* memo = nullptr;
+        if (callee->pure && MemoTable::eligible(callee->arity)) {
+            memo = &memoTable(ip->arg);
+            MemoKey key(sp - callee->arity, callee->arity);
+            if (const Value* hit = memo->find(key)) {
+                sp -= callee->arity;
+                *sp++ = *hit;
+                ++ip;
+                DISPATCH();
+            }
+            memoKeys.push_back(std::move(key));
+        }
+        int64_t nativeResult;
+        if (jit && jit->tryCall(ip->arg, sp - callee->arity, nativeResult)) {
+            if (memo) {
+                memo->store(memoKeys.back(), nativeResult);
+                memoKeys.pop_back();
+            }
+            sp -= callee->arity;
+            *sp++ = nativeResult;
+            ++ip;
+            DISPATCH();
+        }
+        size_t base = (sp - stack.data()) - callee->arity;
+        frames.push_back({callee, ip + 1, base, memo});
+        reserveStack(base + callee->frameSize + callee->maxStack);
+        locals = stack.data() + base;
+        sp = locals + callee->frameSize;
+        code = callee->code.data();
+        edgeCounts = backEdgeCounts[ip->arg].data();
+        ip = code;
+        DISPATCH();
+    }
+    TARGET(CALL_HOST): {
+        const HostFunctions::Entry* host = hosts[ip->arg];
+        if (!host)
+            VM_ERROR("Undefined function: " + SymbolTable::name(program.hostCalls[ip->arg].name));
+        Value result;
+        try {
+            result = host->function(HostFunctions::Arguments(sp - host->arity, host->arity));
+        } catch (const std::exception& e) {
+            VM_ERROR(e.what());
+        }
+        sp -= host->arity;
+        *sp++ = std::move(result);
+        ++ip;
+        DISPATCH();
+    }
+    TARGET(TAIL_CALL): {
+        const CompiledFunction* callee = &program.functions[ip->arg];
+        Frame& frame = frames.back();
+        std::move(sp - callee->arity, sp, locals);
+        frame.function = callee;
+        reserveStack(frame.base + callee->frameSize + callee->maxStack);
+        locals = stack.data() + frame.base;
+        sp = locals + callee->frameSize;
+        code = callee->code.data();
+        edgeCounts = backEdgeCounts[ip->arg].data();
+        ip = code;
+        DISPATCH();
+    }
+    TARGET(RETURN): {
+        Value result = std::move(sp[-1]);
+        Frame finished = frames.back();
+        frames.pop_back();
+        if (finished.memo) {
+            finished.memo->store(memoKeys.back(), result);
+            memoKeys.pop_back();
+        }
+        const Frame& caller = frames.back();
+        sp = stack.data() + finished.base;
+        *sp++ = std::move(result);
+        locals = stack.data() + caller.base;
+        code = caller.function->code.data();
+        edgeCounts = backEdgeCounts[caller.function - program.functions.data()].data();
+        ip = finished.returnAddress;
+        DISPATCH();
+    }
+    TARGET(WRITE):
+        output.writeLine(*--sp);
+        ++ip;
+        DISPATCH();
+    TARGET(FAIL):
+        VM_ERROR(program.messages[ip->arg]);
+        return;
+    TARGET(HALT):
+        return;
+#ifndef PDEV_COMPUTED_GOTO
+    }
+#endif
+#undef VM_ERROR
+#undef VM_INT
+#undef VM_OVERFLOW
+#undef VM_ARITHMETIC
+#undef VM_COMPARE
+#undef VM_OPERANDS
+#undef VM_BACK_EDGE
+#undef DISPATCH
+#undef TARGET
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "bytecode.h"
+#include "hostfunctions.h"
+#include "jit.h"
+#include "lexer.h"
+#include "memo.h"
+#include "output.h"
+#include "value.h"
+#include <memory>
+#include <vector>
+class VM {
+public:
+    VM(const CompiledProgram& program, const Lexer& lexer, OutputChannel& output = OutputChannel::standard());
+    VM(const CompiledProgram& program, const SourceMap& sourceMap, OutputChannel& output = OutputChannel::standard());
+    ~VM();
+    VM(const VM&) = delete;
+    VM& operator=(const VM&) = delete;
+    void run();
+private:
+    // Bits of globalDefined.
+    enum : char { DEFINED = 1, READ_ONLY = 2 };
+    struct Frame {
+        const CompiledFunction* function;
+        const Instruction* returnAddress;
+        size_t base;
+        // Table to store the result in on return, with its key on memoKeys.
+        MemoTable* memo = nullptr;
+    };
+    const CompiledProgram& program;
+    const SourceMap& sourceMap;
+    OutputChannel& output;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    std::vector<Value> globals;
+    std::vector<char> globalDefined;
+    std::vector<std::unique_ptr<MemoTable>> memoTables;
+    std::vector<MemoKey> memoKeys;
+    std::unique_ptr<Jit> jit;
+    // Per function and instruction, how often each back-edge was taken,
+    // for the loop counts in the stats dump (see countedLoops).
+    std::vector<std::vector<uint64_t>> backEdgeCounts;
+    // One per entry of program.hostCalls; null when the name is not
+    // registered with that arity in this process.
+    std::vector<const HostFunctions::Entry*> hosts;
+    // A worker of a parallel for (see runParallel).
+    VM(const VM& parent, size_t base, const ParallelLoop& loop, OutputChannel& output);
+    void execute(const CompiledFunction& entry);
+    void runParallel(const Instruction* ip, size_t base, int64_t bound);
+    void runChunk(const ParallelLoop& loop, uint16_t slot, int64_t first, uint64_t count, int64_t* partials);
+    void countLoops();
+    void reserveStack(size_t size);
+    MemoTable& memoTable(int function);
+    bool enterHotLoop(const Instruction* backEdge, const Value* locals, const Value* sp, int64_t& result);
+    void error(const std::string& message, const Frame& frame, const Instruction* ip) const;
+    void error(const std::string& message, size_t position) const;
+};